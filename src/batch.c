@@ -0,0 +1,385 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2016 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "evaluate.h"
+#include "misc.h"
+#include "pawns.h"
+#include "position.h"
+#include "search.h"
+#include "settings.h"
+#include "thread.h"
+#include "uci.h"
+
+// Records are handed out to the threads in chunks of this size.
+#define BATCH_CHUNK 256
+
+enum { BATCH_EVAL, BATCH_QSEARCH };
+
+static PackedPos *Records;
+static size_t NumRecords;
+static atomic_size_t NextRecord;
+static int Mode;
+
+// batch_job() is run by every thread. It takes chunks of records until
+// none are left and stores the score of each position from white's point
+// of view. Positions in check have no static evaluation and get VALUE_NONE
+// in eval mode.
+
+static void batch_job(Pos *pos)
+{
+  pos->st = pos->stack + 5;
+  int chess960 = option_value(OPT_CHESS960);
+
+  while (1) {
+    size_t first = atomic_fetch_add(&NextRecord, BATCH_CHUNK);
+    if (first >= NumRecords)
+      break;
+    size_t last = min(first + BATCH_CHUNK, NumRecords);
+
+    for (size_t i = first; i < last; i++) {
+      PackedPos *pp = &Records[i];
+
+      Value v;
+      if (!pos_set_packed(pos, pp, chess960))
+        v = VALUE_NONE;
+      else if (Mode == BATCH_QSEARCH)
+        v = batch_qsearch(pos);
+      else if (pos_checkers())
+        v = VALUE_NONE;
+      else
+        v = evaluate(pos);
+
+      if (v != VALUE_NONE && pos_stm() == BLACK)
+        v = -v;
+      pp->score = v;
+    }
+  }
+}
+
+static PackedPos *read_records(const char *fname, size_t *num)
+{
+  FILE *f = fopen(fname, "rb");
+  if (!f)
+    return NULL;
+
+  fseek(f, 0, SEEK_END);
+  *num = ftell(f) / sizeof(PackedPos);
+  fseek(f, 0, SEEK_SET);
+
+  PackedPos *records = malloc(max(*num, 1) * sizeof(PackedPos));
+  *num = fread(records, sizeof(PackedPos), *num, f);
+  fclose(f);
+
+  return records;
+}
+
+static int write_records(const char *fname, PackedPos *records, size_t num)
+{
+  FILE *f = fopen(fname, "wb");
+  if (!f)
+    return 0;
+
+  size_t n = fwrite(records, sizeof(PackedPos), num, f);
+  fclose(f);
+
+  return n == num;
+}
+
+// batch_pack() converts a text file with one FEN per line, optionally
+// followed by the game result "1-0", "0-1" or "1/2-1/2", to PackedPos
+// records.
+
+static void batch_pack(const char *in, const char *out)
+{
+  FILE *f = fopen(in, "r");
+  if (!f) {
+    printf("Unable to open file %s\n", in);
+    return;
+  }
+
+  Pos pos;
+  Stack stack[2];
+  pos.st = stack + 1;
+  int chess960 = option_value(OPT_CHESS960);
+
+  size_t size = 1024, num = 0;
+  PackedPos *records = malloc(size * sizeof(PackedPos));
+  char *line = NULL;
+  size_t len = 0;
+
+  while (getline(&line, &len, f) > 0) {
+    if (line[0] == '\n' || line[0] == '\r' || line[0] == 0)
+      continue;
+
+    if (num == size)
+      records = realloc(records, (size *= 2) * sizeof(PackedPos));
+
+    PackedPos *pp = &records[num++];
+    pos_set(&pos, line, chess960);
+    pos_pack(&pos, pp);
+    pp->result =  strstr(line, "1/2-1/2") ? 1
+                : strstr(line, "1-0")     ? 2
+                : strstr(line, "0-1")     ? 0 : 1;
+    pp->score = 0;
+  }
+
+  free(line);
+  fclose(f);
+
+  if (!write_records(out, records, num))
+    printf("Unable to write file %s\n", out);
+  else
+    printf("Packed %zu positions\n", num);
+
+  free(records);
+}
+
+// batch_codec() compares the throughput of the FEN and PackedPos formats
+// on the FENs of a text file. Each line is read as a FEN and all of them
+// are processed repeatedly until at least a million positions have passed.
+// The round trip of each FEN through the packed format is also checked.
+
+static double codec_rate(uint64_t num, TimePoint elapsed)
+{
+  return (double)num / (elapsed + 1) / 1000.0;
+}
+
+static void batch_codec(const char *in)
+{
+  FILE *f = fopen(in, "r");
+  if (!f) {
+    printf("Unable to open file %s\n", in);
+    return;
+  }
+
+  Pos pos;
+  Stack stack[2];
+  pos.st = stack + 1;
+  int chess960 = option_value(OPT_CHESS960);
+
+  size_t size = 1024, num = 0;
+  char **fens = malloc(size * sizeof(char *));
+  char *line = NULL;
+  size_t len = 0;
+
+  while (getline(&line, &len, f) > 0) {
+    if (line[0] == '\n' || line[0] == '\r' || line[0] == 0)
+      continue;
+    if (num == size)
+      fens = realloc(fens, (size *= 2) * sizeof(char *));
+    fens[num++] = strdup(line);
+  }
+
+  free(line);
+  fclose(f);
+
+  if (!num) {
+    printf("No positions in %s\n", in);
+    free(fens);
+    return;
+  }
+
+  PackedPos *records = malloc(num * sizeof(PackedPos));
+  char fen1[128], fen2[128];
+  size_t mismatches = 0;
+
+  for (size_t i = 0; i < num; i++) {
+    pos_set(&pos, fens[i], chess960);
+    pos_fen(&pos, fen1);
+    pos_pack(&pos, &records[i]);
+    pos_set_packed(&pos, &records[i], chess960);
+    pos_fen(&pos, fen2);
+    mismatches += strcmp(fen1, fen2) != 0;
+  }
+
+  size_t passes = (1000000 + num - 1) / num;
+  uint64_t total = (uint64_t)passes * num, sum = 0;
+  TimePoint t[5];
+
+  t[0] = now();
+  for (size_t n = 0; n < passes; n++)
+    for (size_t i = 0; i < num; i++) {
+      pos_set(&pos, fens[i], chess960);
+      sum += pos.st->key;
+    }
+  t[1] = now();
+  for (size_t n = 0; n < passes; n++)
+    for (size_t i = 0; i < num; i++) {
+      pos_set(&pos, fens[i], chess960);
+      pos_fen(&pos, fen1);
+      sum += fen1[0];
+    }
+  t[2] = now();
+  for (size_t n = 0; n < passes; n++)
+    for (size_t i = 0; i < num; i++) {
+      pos_set_packed(&pos, &records[i], chess960);
+      sum += pos.st->key;
+    }
+  t[3] = now();
+  for (size_t n = 0; n < passes; n++)
+    for (size_t i = 0; i < num; i++) {
+      PackedPos pp;
+      pos_set_packed(&pos, &records[i], chess960);
+      pos_pack(&pos, &pp);
+      sum += pp.occupied;
+    }
+  t[4] = now();
+
+  printf("\n===========================");
+  printf("\nPositions       : %zu x %zu", num, passes);
+  printf("\nRound trip fails: %zu", mismatches);
+  printf("\nFEN in          : %.2f Mpos/s", codec_rate(total, t[1] - t[0]));
+  printf("\nFEN in+out      : %.2f Mpos/s", codec_rate(total, t[2] - t[1]));
+  printf("\nPacked in       : %.2f Mpos/s", codec_rate(total, t[3] - t[2]));
+  printf("\nPacked in+out   : %.2f Mpos/s", codec_rate(total, t[4] - t[3]));
+  printf("\nChecksum        : %" PRIu64 "\n", sum);
+  fflush(stdout);
+
+  for (size_t i = 0; i < num; i++)
+    free(fens[i]);
+  free(fens);
+  free(records);
+}
+
+#ifdef TUNE
+
+// batch_params() prints the evaluation parameters or, if a file is given,
+// loads them. The pawn hash tables are cleared after loading as their
+// entries were computed with the old values.
+
+static void batch_params(const char *fname)
+{
+  if (!fname) {
+    eval_params_print(stdout);
+    return;
+  }
+
+  FILE *f = fopen(fname, "r");
+  if (!f) {
+    printf("Unable to open file %s\n", fname);
+    return;
+  }
+
+  int ok = eval_params_read(f);
+  fclose(f);
+
+  if (!ok) {
+    printf("Parameter file %s does not match\n", fname);
+    return;
+  }
+
+  for (int idx = 0; idx < Threads.num_threads; idx++)
+    memset(Threads.pos[idx]->pawnTable, 0, PAWN_ENTRIES * sizeof(PawnEntry));
+
+  printf("Loaded %d parameters\n", eval_params_num());
+}
+
+#endif
+
+// batch() is called when the engine receives the "batch" command. It
+// processes files of PackedPos records on all threads without going
+// through the UCI search:
+//
+//   batch pack <fenfile> <outfile>     convert FENs to PackedPos records
+//   batch codec <fenfile>              time FEN against PackedPos coding
+//   batch eval <infile> <outfile>      store the static evaluation
+//   batch qsearch <infile> <outfile>   store the quiescence search value
+//   batch params [<file>]              print or load the eval parameters
+//
+// The last one needs a build with tune=yes.
+
+void batch(char *str)
+{
+  char *token = strtok(str, " \t");
+  char *in = strtok(NULL, " \t");
+  char *out = strtok(NULL, " \t");
+
+  if (Signals.searching)
+    thread_wait_for_search_finished(threads_main());
+
+  process_delayed_settings();
+
+  if (token && strcmp(token, "params") == 0) {
+#ifdef TUNE
+    batch_params(in);
+#else
+    printf("Parameters can only be changed in a build with tune=yes\n");
+#endif
+    return;
+  }
+
+  if (token && in && strcmp(token, "codec") == 0) {
+    batch_codec(in);
+    return;
+  }
+
+  if (!token || !in || !out) {
+    printf("Usage: batch eval|qsearch|pack <infile> <outfile>\n");
+    return;
+  }
+
+  if (strcmp(token, "pack") == 0) {
+    batch_pack(in, out);
+    return;
+  }
+
+  if (strcmp(token, "eval") == 0)
+    Mode = BATCH_EVAL;
+  else if (strcmp(token, "qsearch") == 0)
+    Mode = BATCH_QSEARCH;
+  else {
+    printf("Unknown batch mode: %s\n", token);
+    return;
+  }
+
+  Records = read_records(in, &NumRecords);
+  if (!Records) {
+    printf("Unable to open file %s\n", in);
+    return;
+  }
+
+  if (Mode == BATCH_QSEARCH)
+    batch_qsearch_init();
+
+  TimePoint elapsed = now();
+  atomic_store(&NextRecord, 0);
+  threads_run_job(batch_job);
+  elapsed = now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
+
+  if (!write_records(out, Records, NumRecords))
+    printf("Unable to write file %s\n", out);
+
+  printf("\n===========================");
+  printf("\nTotal time (ms) : %" PRIu64, elapsed);
+  printf("\nPositions       : %zu", NumRecords);
+  printf("\nPositions/second: %" PRIu64 "\n",
+         (uint64_t)NumRecords * 1000 / elapsed);
+  fflush(stdout);
+
+  free(Records);
+  Records = NULL;
+}
@@ -24,7 +24,9 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "evaluate.h"
 #include "misc.h"
+#include "movegen.h"
 #include "position.h"
 #include "search.h"
 #include "settings.h"
@@ -90,6 +92,24 @@ static char *Defaults[] = {
   "setoption name UCI_Chess960 value false"
 };
 
+// Endgames with locked pawns, fortresses and perpetual checks where most
+// lines end in a repetition. Selected with "bench <hash> <threads> <depth>
+// repetition" to measure the cost of repetition detection.
+static char *Repetitions[] = {
+  "8/8/1k6/1p1p1p2/1P1P1P2/1K6/8/8 w - - 0 1",
+  "4k3/8/8/p1p1p1p1/P1P1P1P1/8/8/4K3 w - - 0 1",
+  "8/4k3/1p2b3/p1p5/P1P1B3/1P2K3/8/8 w - - 0 1",
+  "8/8/4k3/8/8/R7/5K2/r7 w - - 0 1",
+  "8/8/3k4/8/3q4/8/3QK3/8 w - - 0 1",
+  "6k1/5p1p/6p1/8/8/6P1/q4P1P/3Q2K1 w - - 0 1",
+  "8/5k2/3b4/5p2/5P2/2B2K2/8/8 w - - 0 1",
+  "8/8/8/2k5/2p5/2P1K3/8/8 w - - 0 1",
+  "3k4/8/3K4/3P4/8/8/8/r7 w - - 0 1",
+  "8/2k5/8/1p6/1P1R4/8/5r2/2K5 w - - 0 1",
+  "8/6k1/8/4N3/8/5K2/8/8 w - - 0 1",
+  "6k1/6p1/5pKp/5P1P/6P1/8/8/8 w - - 0 1"
+};
+
 // benchmark() runs a simple benchmark by letting Stockfish analyze a set
 // of positions for a given limit each. There are five parameters: the
 // transposition table size, the number of search threads that should
@@ -98,6 +118,35 @@ static char *Defaults[] = {
 // format (defaults are the positions defined above) and the type of the
 // limit value: depth (default), time in millisecs or number of nodes.
 
+// eval_bench() evaluates the position and all positions one legal move
+// away from it 'rounds' times. It is run by "bench 16 1 <rounds> <fens>
+// eval" to measure the speed of evaluate() in isolation. The checksum of
+// the evaluations allows different builds to be compared.
+
+static uint64_t eval_bench(Pos *pos, int64_t rounds, int64_t *checksum)
+{
+  uint64_t cnt = 0;
+  ExtMove *list = (pos->st-1)->endMoves;
+  ExtMove *end = generate_legal(pos, list);
+
+  for (int64_t r = 0; r < rounds; r++) {
+    if (!pos_checkers()) {
+      *checksum += evaluate(pos);
+      cnt++;
+    }
+    for (ExtMove *m = list; m < end; m++) {
+      do_move(pos, m->move, gives_check(pos, pos->st, m->move));
+      if (!pos_checkers()) {
+        *checksum += evaluate(pos);
+        cnt++;
+      }
+      undo_move(pos, m->move);
+    }
+  }
+
+  return cnt;
+}
+
 void benchmark(Pos *current, char *str)
 {
   char *token;
@@ -149,6 +198,10 @@ void benchmark(Pos *current, char *str)
     fens = Defaults;
     num_fens = sizeof(Defaults) / sizeof(char *);
   }
+  else if (strcmp(fenFile, "repetition") == 0) {
+    fens = Repetitions;
+    num_fens = sizeof(Repetitions) / sizeof(char *);
+  }
   else if (strcmp(fenFile, "current") == 0) {
     fens = malloc(sizeof(char *));
     fens[0] = malloc(128);
@@ -179,10 +232,13 @@ void benchmark(Pos *current, char *str)
   }
 
   uint64_t nodes = 0;
+  int64_t checksum = 0;
   Pos pos;
   pos.stack = malloc(215 * sizeof(Stack));
   pos.st = pos.stack + 5;
   pos.moveList = malloc(10000 * sizeof(ExtMove));
+  pos.pawnTable = threads_main()->pawnTable;
+  pos.materialTable = threads_main()->materialTable;
   TimePoint elapsed = now();
 
   int num_opts = 0;
@@ -213,8 +269,11 @@ void benchmark(Pos *current, char *str)
 
     fprintf(stderr, "\nPosition: %" FMT_Z "u/%" FMT_Z "u\n", ++j, num_fens - num_opts);
 
-    if (strcmp(limitType, "perft") == 0)
-      nodes += perft(&pos, Limits.depth * ONE_PLY);
+    if (strcmp(limitType, "perft") == 0 || strcmp(limitType, "divide") == 0)
+      nodes += perft(&pos, Limits.depth * ONE_PLY,
+                     strcmp(limitType, "divide") == 0);
+    else if (strcmp(limitType, "eval") == 0)
+      nodes += eval_bench(&pos, limit, &checksum);
     else {
       Limits.startTime = now();
       start_thinking(&pos);
@@ -233,7 +292,10 @@ void benchmark(Pos *current, char *str)
                   "\nNodes/second    : %" PRIu64 "\n",
                   elapsed, nodes, 1000 * nodes / elapsed);
 
-  if (fens != Defaults) {
+  if (strcmp(limitType, "eval") == 0)
+    fprintf(stderr, "Eval checksum   : %" PRId64 "\n", checksum);
+
+  if (fens != Defaults && fens != Repetitions) {
     for (size_t i = 0; i < num_fens; i++)
       free(fens[i]);
     free(fens);
@@ -242,3 +304,337 @@ void benchmark(Pos *current, char *str)
   free(pos.moveList);
 }
 
+
+
+// microbench() is called when the engine receives the "microbench [reps]"
+// command. It times single primitives in tight loops over a fixed set of
+// positions: the default bench positions and all positions one legal move
+// away from them. Each primitive is first calibrated to take about 20 ms
+// per repetition and then run 'reps' times (default 9). One line per
+// primitive is printed in the form
+//
+//   <primitive> <min ns/op> <median ns/op> <ops per pass>
+//
+// so that the output of different builds can be compared by a script.
+
+typedef struct {
+  Pos pos;
+  Stack stack[3];
+  ExtMove moves[MAX_MOVES];
+  int numMoves;
+} MicroPos;
+
+static MicroPos *Micro;
+static int NumMicro;
+static Square *MicroSq;
+static Bitboard *MicroOcc, *MicroAttacks;
+static int NumSliders;
+static uint64_t MicroSum; // Keeps the work from being optimised away
+
+static void micro_add(Pos *src)
+{
+  MicroPos *mp = &Micro[NumMicro++];
+  PackedPos pp;
+
+  pos_pack(src, &pp);
+  mp->pos.st = mp->stack + 1;
+  pos_set_packed(&mp->pos, &pp, src->chess960);
+  mp->pos.pawnTable = threads_main()->pawnTable;
+  mp->pos.materialTable = threads_main()->materialTable;
+  mp->numMoves = generate_legal(&mp->pos, mp->moves) - mp->moves;
+}
+
+static void micro_init(void)
+{
+  Pos pos;
+  pos.stack = malloc(215 * sizeof(Stack));
+  pos.st = pos.stack + 5;
+  pos.moveList = malloc(10000 * sizeof(ExtMove));
+
+  size_t num_fens = sizeof(Defaults) / sizeof(char *);
+  Micro = malloc(num_fens * MAX_MOVES * sizeof(MicroPos));
+  NumMicro = 0;
+
+  for (size_t i = 0; i < num_fens; i++) {
+    char buf[128];
+
+    if (strncmp(Defaults[i], "setoption ", 9) == 0) {
+      strcpy(buf, Defaults[i] + 10);
+      setoption(buf);
+      continue;
+    }
+
+    strcpy(buf, "fen ");
+    strncat(buf, Defaults[i], 127 - 4);
+    position(&pos, buf);
+    micro_add(&pos);
+
+    ExtMove list[MAX_MOVES];
+    ExtMove *end = generate_legal(&pos, list);
+    for (ExtMove *m = list; m < end; m++) {
+      do_move(&pos, m->move, gives_check(&pos, pos.st, m->move));
+      micro_add(&pos);
+      undo_move(&pos, m->move);
+    }
+  }
+
+  free(pos.stack);
+  free(pos.moveList);
+}
+
+// The bishops, rooks and queens of all positions with their occupancies
+// are the input of the attacks_bb() and attacks_bb_n() benchmarks.
+static void micro_init_sliders(void)
+{
+  NumSliders = 0;
+  for (int i = 0; i < NumMicro; i++)
+    NumSliders += popcount(Micro[i].pos.byTypeBB[BISHOP] | Micro[i].pos.byTypeBB[ROOK]);
+  MicroSq = malloc((NumSliders + 1) * sizeof(Square));
+  MicroOcc = malloc((NumSliders + 1) * sizeof(Bitboard));
+  MicroAttacks = malloc((NumSliders + 1) * sizeof(Bitboard));
+
+  for (int i = 0, n = 0; i < NumMicro; i++) {
+    Pos *pos = &Micro[i].pos;
+    for (Bitboard b = pieces_p(ROOK) | pieces_p(BISHOP); b; n++) {
+      MicroSq[n] = pop_lsb(&b);
+      MicroOcc[n] = pieces();
+    }
+  }
+}
+
+static void micro_free(void)
+{
+  free(Micro);
+  free(MicroSq);
+  free(MicroOcc);
+  free(MicroAttacks);
+}
+
+static uint64_t mb_captures(void)
+{
+  ExtMove list[MAX_MOVES];
+  uint64_t ops = 0;
+
+  for (int i = 0; i < NumMicro; i++) {
+    Pos *pos = &Micro[i].pos;
+    if (pos_checkers())
+      continue;
+    MicroSum += generate_captures(pos, list) - list;
+    ops++;
+  }
+  return ops;
+}
+
+static uint64_t mb_quiets(void)
+{
+  ExtMove list[MAX_MOVES];
+  uint64_t ops = 0;
+
+  for (int i = 0; i < NumMicro; i++) {
+    Pos *pos = &Micro[i].pos;
+    if (pos_checkers())
+      continue;
+    MicroSum += generate_quiets(pos, list) - list;
+    ops++;
+  }
+  return ops;
+}
+
+static uint64_t mb_evasions(void)
+{
+  ExtMove list[MAX_MOVES];
+  uint64_t ops = 0;
+
+  for (int i = 0; i < NumMicro; i++) {
+    Pos *pos = &Micro[i].pos;
+    if (!pos_checkers())
+      continue;
+    MicroSum += generate_evasions(pos, list) - list;
+    ops++;
+  }
+  return ops;
+}
+
+static uint64_t mb_legal(void)
+{
+  ExtMove list[MAX_MOVES];
+
+  for (int i = 0; i < NumMicro; i++)
+    MicroSum += generate_legal(&Micro[i].pos, list) - list;
+  return NumMicro;
+}
+
+static uint64_t mb_do_undo(void)
+{
+  uint64_t ops = 0;
+
+  for (int i = 0; i < NumMicro; i++) {
+    Pos *pos = &Micro[i].pos;
+    for (int j = 0; j < Micro[i].numMoves; j++) {
+      Move m = Micro[i].moves[j].move;
+      do_move(pos, m, gives_check(pos, pos->st, m));
+      MicroSum += pos_key();
+      undo_move(pos, m);
+    }
+    ops += Micro[i].numMoves;
+  }
+  return ops;
+}
+
+static uint64_t mb_gives_check(void)
+{
+  uint64_t ops = 0;
+
+  for (int i = 0; i < NumMicro; i++) {
+    Pos *pos = &Micro[i].pos;
+    for (int j = 0; j < Micro[i].numMoves; j++)
+      MicroSum += gives_check(pos, pos->st, Micro[i].moves[j].move);
+    ops += Micro[i].numMoves;
+  }
+  return ops;
+}
+
+// The moves of the next position in the set stand in for tt moves and
+// killers, which are often not pseudo-legal.
+static uint64_t mb_pseudo_legal(void)
+{
+  uint64_t ops = 0;
+
+  for (int i = 0; i < NumMicro; i++) {
+    Pos *pos = &Micro[i].pos;
+    MicroPos *next = &Micro[(i + 1) % NumMicro];
+    for (int j = 0; j < Micro[i].numMoves; j++)
+      MicroSum += is_pseudo_legal(pos, Micro[i].moves[j].move);
+    for (int j = 0; j < next->numMoves; j++)
+      MicroSum += is_pseudo_legal(pos, next->moves[j].move);
+    ops += Micro[i].numMoves + next->numMoves;
+  }
+  return ops;
+}
+
+static uint64_t mb_see(void)
+{
+  uint64_t ops = 0;
+
+  for (int i = 0; i < NumMicro; i++) {
+    Pos *pos = &Micro[i].pos;
+    for (int j = 0; j < Micro[i].numMoves; j++) {
+      Move m = Micro[i].moves[j].move;
+      if (!is_capture_or_promotion(pos, m))
+        continue;
+      MicroSum += see_test(pos, m, 0);
+      ops++;
+    }
+  }
+  return ops;
+}
+
+static uint64_t mb_evaluate(void)
+{
+  uint64_t ops = 0;
+
+  for (int i = 0; i < NumMicro; i++) {
+    Pos *pos = &Micro[i].pos;
+    if (pos_checkers())
+      continue;
+    MicroSum += evaluate(pos);
+    ops++;
+  }
+  return ops;
+}
+
+static uint64_t mb_attacks(void)
+{
+  for (int n = 0; n < NumSliders; n++)
+    MicroAttacks[n] = attacks_bb(QUEEN, MicroSq[n], MicroOcc[n]);
+  MicroSum += MicroAttacks[NumSliders / 2];
+  return NumSliders;
+}
+
+static uint64_t mb_attacks_n(void)
+{
+  attacks_bb_n(QUEEN, MicroSq, MicroOcc, MicroAttacks, NumSliders);
+  MicroSum += MicroAttacks[NumSliders / 2];
+  return NumSliders;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// see_test() comes before evaluate(), which leaves attack maps behind
+// that see_test() would otherwise pick up.
+static const struct {
+  const char *name;
+  uint64_t (*fn)(void);
+} MicroBenches[] = {
+  { "generate_captures", mb_captures },
+  { "generate_quiets",   mb_quiets },
+  { "generate_evasions", mb_evasions },
+  { "generate_legal",    mb_legal },
+  { "do_undo_move",      mb_do_undo },
+  { "gives_check",       mb_gives_check },
+  { "is_pseudo_legal",   mb_pseudo_legal },
+  { "see_test",          mb_see },
+  { "evaluate",          mb_evaluate },
+  { "attacks_bb",        mb_attacks },
+  { "attacks_bb_n",      mb_attacks_n }
+};
+
+static uint64_t micro_time(uint64_t (*fn)(void), int loops, uint64_t *ops)
+{
+  struct timeval start, end;
+
+  gettimeofday(&start, NULL);
+  for (int l = 0; l < loops; l++)
+    *ops = fn();
+  gettimeofday(&end, NULL);
+
+  return  (uint64_t)(end.tv_sec - start.tv_sec) * 1000000
+        + end.tv_usec - start.tv_usec;
+}
+
+void microbench(char *str)
+{
+  int reps = atoi(str);
+  if (reps <= 0)
+    reps = 9;
+
+  if (Signals.searching)
+    thread_wait_for_search_finished(threads_main());
+
+  micro_init();
+  micro_init_sliders();
+  MicroSum = 0;
+
+  printf("# positions %d reps %d\n", NumMicro, reps);
+  printf("# primitive min_ns median_ns ops\n");
+
+  for (size_t b = 0; b < sizeof(MicroBenches) / sizeof(MicroBenches[0]); b++) {
+    uint64_t ops;
+    double ns[64];
+
+    // Calibrate the number of passes per repetition to about 20 ms
+    uint64_t t = micro_time(MicroBenches[b].fn, 1, &ops);
+    int loops = (int)max(1, min(1000000, 20000 / max(t, 1)));
+
+    reps = min(reps, 64);
+    for (int r = 0; r < reps; r++) {
+      t = micro_time(MicroBenches[b].fn, loops, &ops);
+      ns[r] = ops ? t * 1000.0 / ((double)loops * ops) : 0;
+    }
+    qsort(ns, reps, sizeof(double), cmp_double);
+
+    printf("%-17s %8.2f %8.2f %" PRIu64 "\n", MicroBenches[b].name,
+           ns[0], ns[reps / 2], ops);
+  }
+
+  // Make sure the work is not optimised away
+  if (MicroSum == 1)
+    printf("\n");
+  fflush(stdout);
+
+  micro_free();
+}
@@ -27,7 +27,9 @@
 #define MAX_INDEX (2*24*64*64)
 
 // Each uint32_t stores results of 32 positions, one per bit
-static uint32_t KPKBitbase[MAX_INDEX / 32];
+#ifndef PREGEN
+uint32_t KPKBitbase[MAX_INDEX / 32];
+#endif
 
 // A KPK bitbase index is an integer in [0, IndexMax] range
 //
@@ -130,6 +132,10 @@ static uint8_t classify(uint8_t *db, unsigned idx)
 
 void bitbases_init()
 {
+  // A build with pregenerated tables has the bitbase in its data section
+  if (HasPregen)
+    return;
+
   uint8_t *db = malloc(MAX_INDEX);
   unsigned idx, repeat = 1;
 
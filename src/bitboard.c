@@ -18,6 +18,8 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <string.h>
+
 #include "bitboard.h"
 #include "misc.h"
 
@@ -260,3 +262,93 @@ void bitboards_init()
   }
 }
 
+
+
+// bitboards_time() initializes the bitboard tables and returns the time in
+// microseconds taken by a fixed sequence of slider attack lookups. A fat
+// binary calls it for each of its variants to pick the fastest one.
+
+uint64_t bitboards_time(void)
+{
+  Bitboard occupied[1024], sum = 0;
+  PRNG rng;
+  struct timeval start, end;
+
+  bitboards_init();
+
+  prng_init(&rng, 1070372);
+  for (int i = 0; i < 1024; i++)
+    occupied[i] = prng_sparse_rand(&rng) | prng_sparse_rand(&rng);
+
+  gettimeofday(&start, NULL);
+  for (int n = 0; n < 16; n++)
+    for (int i = 0; i < 1024; i++)
+      for (Square s = 0; s < 64; s++)
+        sum ^=  attacks_bb_bishop(s, occupied[i] ^ sum)
+              ^ attacks_bb_rook(s, occupied[i] ^ sum);
+  gettimeofday(&end, NULL);
+
+  // Make sure the lookups are not optimised away
+  if (sum == 1)
+    printf("\n");
+
+  return  (uint64_t)(end.tv_sec - start.tv_sec) * 1000000
+        + end.tv_usec - start.tv_usec;
+}
+
+
+// attacks_bench() is called when the engine receives the "attackbench"
+// command. It compares table lookups by attacks_bb() with the batched
+// attacks_bb_n() on random squares and occupancies and prints the time
+// per attack for each slider type.
+
+void attacks_bench(void)
+{
+  enum { N = 4096, PASSES = 256 };
+  static Square sq[N];
+  static Bitboard occupied[N], table[N], batched[N];
+  static const char *names[] = { "", "", "", "bishop", "rook", "queen" };
+  Bitboard sum = 0;
+  PRNG rng;
+  struct timeval start, end;
+
+  prng_init(&rng, 1070372);
+  for (int i = 0; i < N; i++) {
+    sq[i] = prng_rand(&rng) & 63;
+    occupied[i] = prng_sparse_rand(&rng) | prng_sparse_rand(&rng);
+  }
+
+  printf("Batched attacks: %s\n",
+         HasAvx512 ? "AVX-512, 8 per pass" : HasAvx2 ? "AVX2, 4 per pass"
+                                                      : "table lookups");
+
+  for (int pt = BISHOP; pt <= QUEEN; pt++) {
+    uint64_t t[2];
+
+    gettimeofday(&start, NULL);
+    for (int n = 0; n < PASSES; n++) {
+      for (int i = 0; i < N; i++)
+        table[i] = attacks_bb(pt, sq[i], occupied[i]);
+      sum += table[n];
+    }
+    gettimeofday(&end, NULL);
+    t[0] = (end.tv_sec - start.tv_sec) * 1000000 + end.tv_usec - start.tv_usec;
+
+    gettimeofday(&start, NULL);
+    for (int n = 0; n < PASSES; n++) {
+      attacks_bb_n(pt, sq, occupied, batched, N);
+      sum += batched[n];
+    }
+    gettimeofday(&end, NULL);
+    t[1] = (end.tv_sec - start.tv_sec) * 1000000 + end.tv_usec - start.tv_usec;
+
+    printf("%-7s table %6.2f ns  batched %6.2f ns%s\n", names[pt],
+           t[0] * 1000.0 / (N * PASSES), t[1] * 1000.0 / (N * PASSES),
+           memcmp(table, batched, sizeof(table)) ? "  MISMATCH" : "");
+  }
+
+  // Make sure the lookups are not optimised away
+  if (sum == 1)
+    printf("\n");
+  fflush(stdout);
+}
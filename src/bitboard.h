@@ -27,8 +27,11 @@
 
 void bitbases_init();
 unsigned bitbases_probe(Square wksq, Square wpsq, Square bksq, unsigned us);
+extern uint32_t KPKBitbase[2 * 24 * 64 * 64 / 32];
 
 void bitboards_init();
+uint64_t bitboards_time(void);
+void attacks_bench(void);
 void print_pretty(Bitboard b);
 
 #define AllSquares (~0ULL)
@@ -254,6 +257,10 @@ INLINE unsigned distance_r(Square x, Square y)
 #include "bmi2-plain.h"
 #endif
 
+#ifdef USE_AVX2
+#include "kogge-stone.h"
+#endif
+
 INLINE Bitboard attacks_bb(int pt, Square s, Bitboard occupied)
 {
   assert(pt != PAWN);
@@ -270,6 +277,31 @@ INLINE Bitboard attacks_bb(int pt, Square s, Bitboard occupied)
   }
 }
 
+// attacks_bb_n() stores in attacks[] the attacks of n sliders of type pt
+// (BISHOP, ROOK or QUEEN) placed on sq[] with occupancies occupied[]. With
+// AVX2 or AVX-512 the sliders are processed 4 or 8 at a time by Kogge-Stone
+// fills, which avoids the scattered table loads of attacks_bb(). Without
+// them, and for the remainder, the table lookups are used.
+
+INLINE void attacks_bb_n(int pt, const Square *sq, const Bitboard *occupied,
+                         Bitboard *attacks, int n)
+{
+  assert(pt == BISHOP || pt == ROOK || pt == QUEEN);
+
+  int i = 0;
+#if defined(USE_AVX512)
+  for (; i + 8 <= n; i += 8)
+    _mm512_storeu_si512(attacks + i, ks_attacks8(pt, sq + i, occupied + i));
+#endif
+#if defined(USE_AVX2)
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_si256((__m256i *)(attacks + i),
+                        ks_attacks4(pt, sq + i, occupied + i));
+#endif
+  for (; i < n; i++)
+    attacks[i] = attacks_bb(pt, sq[i], occupied[i]);
+}
+
 
 // popcount() counts the number of non-zero bits in a bitboard.
 
@@ -4,8 +4,10 @@ uint16_t *RookAttacks[64];
 Bitboard BishopMasks[64], BishopMasks2[64];
 uint16_t *BishopAttacks[64];
 
-static uint16_t BishopTable[5248];
-static uint16_t RookTable[102400];
+#ifndef PREGEN
+uint16_t BishopTable[5248];
+uint16_t RookTable[102400];
+#endif
 
 typedef unsigned (Fn)(Square, Bitboard);
 
@@ -23,6 +25,11 @@ static void init_bmi2(uint16_t table[], uint16_t *attacks[], Bitboard masks[],
     masks2[s] = sliding_attack(deltas, s, 0);
     masks[s] = masks2[s] & ~edges;
 
+    if (HasPregen) {
+      table += 1 << popcount(masks[s]);
+      continue;
+    }
+
     // Use Carry-Rippler trick to enumerate all subsets of masks[s] and
     // fill the attacks table.
     b = 0;
@@ -4,6 +4,11 @@ extern Bitboard RookMasks[64], RookMasks2[64];
 extern Bitboard BishopMasks[64], BishopMasks2[64];
 extern uint16_t *RookAttacks[64];
 extern uint16_t *BishopAttacks[64];
+extern uint16_t BishopTable[5248];
+extern uint16_t RookTable[102400];
+
+// Tables written out by 'make pregen-build'
+#define SLIDER_TABLES(X) X(BishopTable, uint16_t) X(RookTable, uint16_t)
 
 INLINE unsigned bmi2_index_bishop(Square s, Bitboard occupied)
 {
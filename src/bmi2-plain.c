@@ -4,8 +4,10 @@ Bitboard *RookAttacks[64];
 Bitboard BishopMasks[64];
 Bitboard *BishopAttacks[64];
 
+#ifndef PREGEN
 Bitboard BishopTable[5248];
 Bitboard RookTable[102400];
+#endif
 
 typedef unsigned (Fn)(Square, Bitboard);
 
@@ -22,6 +24,11 @@ static void init_bmi2(Bitboard table[], Bitboard *attacks[], Bitboard masks[],
 
     masks[s] = sliding_attack(deltas, s, 0) & ~edges;
 
+    if (HasPregen) {
+      table += 1 << popcount(masks[s]);
+      continue;
+    }
+
     // Use Carry-Rippler trick to enumerate all subsets of masks[s] and
     // fill the attacks table.
     b = 0;
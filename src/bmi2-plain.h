@@ -4,6 +4,11 @@ extern Bitboard RookMasks[64];
 extern Bitboard BishopMasks[64];
 extern Bitboard *RookAttacks[64];
 extern Bitboard *BishopAttacks[64];
+extern Bitboard BishopTable[5248];
+extern Bitboard RookTable[102400];
+
+// Tables written out by 'make pregen-build'
+#define SLIDER_TABLES(X) X(BishopTable, Bitboard) X(RookTable, Bitboard)
 
 INLINE unsigned bmi2_index_bishop(Square s, Bitboard occupied)
 {
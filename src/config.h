@@ -7,8 +7,9 @@
 #ifdef USE_PEXT
 //#define BMI2_PLAIN
 #define BMI2_FANCY
+#elif defined(USE_BLACK_MAGIC)
+#define MAGIC_BLACK
 #else
-//#define MAGIC_BLACK
 #define MAGIC_PLAIN
 //#define MAGIC_FANCY
 #endif
@@ -19,6 +19,8 @@
 */
 
 #include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>   // For std::memset
 
 #include "bitboard.h"
@@ -87,7 +89,7 @@ typedef struct EvalInfo EvalInfo;
 // MobilityBonus[PieceType-2][attacked] contains bonuses for middle and
 // end game, indexed by piece type and number of attacked squares in the
 // mobility area.
-static const Score MobilityBonus[4][32] = {
+TUNABLE Score MobilityBonus[4][32] = {
   { S(-75,-76), S(-57,-54), S( -9,-28), S( -2,-10), S(  6,  5), S( 14, 12), // Knights
     S( 22, 26), S( 29, 29), S( 36, 29) },
   { S(-48,-59), S(-20,-23), S( 16, -3), S( 26, 13), S( 38, 24), S( 51, 42), // Bishops
@@ -106,29 +108,29 @@ static const Score MobilityBonus[4][32] = {
 // Outpost[knight/bishop][supported by pawn] contains bonuses for minors
 // if they can reach an outpost square, bigger if that square is supported0
 // by a pawn. If the minor occupies an outpost square, then score is doubled.
-static const Score Outpost[][2] = {
+TUNABLE Score Outpost[][2] = {
   { S(22, 6), S(36,12) }, // Knight
   { S( 9, 2), S(15, 5) }  // Bishop
 };
 
 // RookOnFile[semiopen/open] contains bonuses for each rook when there is
 // no friendly pawn on the rook file.
-static const Score RookOnFile[2] = { S(20, 7), S(45, 20) };
+TUNABLE Score RookOnFile[2] = { S(20, 7), S(45, 20) };
 
 // ThreatByMinor/ByRook[attacked PieceType] contains bonuses according to
 // which piece type attacks which one. Attacks on lesser pieces which are
 // pawn defended are not considered.
-static const Score ThreatByMinor[8] = {
+TUNABLE Score ThreatByMinor[8] = {
   S(0, 0), S(0, 33), S(45, 43), S(46, 47), S(72,107), S(48,118)
 };
 
-static const Score ThreatByRook[8] = {
+TUNABLE Score ThreatByRook[8] = {
   S(0, 0), S(0, 25), S(40, 62), S(40, 59), S( 0, 34), S(35, 48)
 };
 
 // ThreatByKing[on one/on many] contains bonuses for King attacks on
 // pawns or pieces which are not pawn-defended.
-static const Score ThreatByKing[2] = { S(3, 62), S(9, 138) };
+TUNABLE Score ThreatByKing[2] = { S(3, 62), S(9, 138) };
 
 // Passed[mg/eg][Rank] contains midgame and endgame bonuses for passed pawns.
 // We don't use a Score because we process the two components independently.
@@ -138,36 +140,36 @@ static const Value Passed[][8] = {
 };
 
 // PassedFile[File] contains a bonus according to the file of a passed pawn
-static const Score PassedFile[8] = {
+TUNABLE Score PassedFile[8] = {
   S(  9, 10), S( 2, 10), S( 1, -8), S(-20,-12),
   S(-20,-12), S( 1, -8), S( 2, 10), S(  9, 10)
 };
 
 // KingProtector[PieceType-2] contains a bonus according to distance from king
-const Score KingProtector[] = { S(-3, -5), S(-4, -3), S(-3, 0), S(-1, 1) };
+TUNABLE Score KingProtector[] = { S(-3, -5), S(-4, -3), S(-3, 0), S(-1, 1) };
 
 // Assorted bonuses and penalties used by evaluation
-static const Score MinorBehindPawn     = S( 16,  0);
-static const Score BishopPawns         = S(  8, 12);
-static const Score LongRangedBishop    = S( 22,  0);
-static const Score RookOnPawn          = S(  8, 24);
-static const Score TrappedRook         = S( 92,  0);
-static const Score WeakQueen           = S( 50, 10);
-static const Score OtherCheck          = S( 10, 10);
-static const Score CloseEnemies        = S(  7,  0);
-static const Score PawnlessFlank       = S( 20, 80);
-static const Score ThreatByHangingPawn = S( 71, 61);
-static const Score ThreatBySafePawn    = S(192,175);
-static const Score ThreatByRank        = S( 16,  3);
-static const Score Hanging             = S( 48, 27);
-static const Score WeakUnopposedPawn   = S(  5, 25);
-static const Score ThreatByPawnPush    = S( 38, 22);
-static const Score HinderPassedPawn    = S(  7,  0);
+TUNABLE Score MinorBehindPawn     = S( 16,  0);
+TUNABLE Score BishopPawns         = S(  8, 12);
+TUNABLE Score LongRangedBishop    = S( 22,  0);
+TUNABLE Score RookOnPawn          = S(  8, 24);
+TUNABLE Score TrappedRook         = S( 92,  0);
+TUNABLE Score WeakQueen           = S( 50, 10);
+TUNABLE Score OtherCheck          = S( 10, 10);
+TUNABLE Score CloseEnemies        = S(  7,  0);
+TUNABLE Score PawnlessFlank       = S( 20, 80);
+TUNABLE Score ThreatByHangingPawn = S( 71, 61);
+TUNABLE Score ThreatBySafePawn    = S(192,175);
+TUNABLE Score ThreatByRank        = S( 16,  3);
+TUNABLE Score Hanging             = S( 48, 27);
+TUNABLE Score WeakUnopposedPawn   = S(  5, 25);
+TUNABLE Score ThreatByPawnPush    = S( 38, 22);
+TUNABLE Score HinderPassedPawn    = S(  7,  0);
 
 // Penalty for a bishop on a1/h1 (a8/h8 for black) which is trapped by
 // a friendly pawn on b2/g2 (b7/g7 for black). This can obviously only
 // happen in Chess960 games.
-static const Score TrappedBishopA1H1 = S(50, 50);
+TUNABLE Score TrappedBishopA1H1 = S(50, 50);
 
 #undef S
 #undef V
@@ -186,6 +188,46 @@ static const int KingAttackWeights[8] = { 0, 0, 78, 56, 45, 11 };
 #define SpaceThreshold 12222
 
 
+// In a build with TRACE defined, evaluate() records the contribution of
+// each term for both colors while eval_trace() is running. Terms are
+// indexed by piece type or by one of the values below.
+#ifdef TRACE
+
+enum {
+  TERM_MATERIAL = 8, TERM_IMBALANCE, TERM_MOBILITY, TERM_THREAT, TERM_PASSED,
+  TERM_SPACE, TERM_INITIATIVE, TERM_TOTAL, TERM_NB
+};
+
+static Score TraceScores[TERM_NB][2];
+static int Tracing;
+
+static void trace_add(int idx, int c, Score s)
+{
+  if (Tracing)
+    TraceScores[idx][c] = s;
+}
+
+#else
+
+#define Tracing 0
+#define trace_add(idx, c, s) do {} while (0)
+
+#endif
+
+
+// With USE_AVX2 the attacks of sliders are computed by Kogge-Stone fills
+// in SIMD registers instead of by magic bitboard lookups.
+#ifdef USE_AVX2
+#define mobility_attacks_bishop(s, occ) ks_attacks_bishop(s, occ)
+#define mobility_attacks_rook(s, occ) ks_attacks_rook(s, occ)
+#define mobility_attacks_queen(s, occ) ks_attacks_queen(s, occ)
+#else
+#define mobility_attacks_bishop(s, occ) attacks_bb_bishop(s, occ)
+#define mobility_attacks_rook(s, occ) attacks_bb_rook(s, occ)
+#define mobility_attacks_queen(s, occ) attacks_bb(QUEEN, s, occ)
+#endif
+
+
 // eval_init() initializes king and attack bitboards for a given color
 // adding pawn attacks. To be done at the beginning of the evaluation.
 
@@ -241,9 +283,10 @@ INLINE Score evaluate_piece(const Pos *pos, EvalInfo *ei, Score *mobility,
 
   loop_through_pieces(Us, Pt, s) {
     // Find attacked squares, including x-ray attacks for bishops and rooks
-    b = Pt == BISHOP ? attacks_bb_bishop(s, pieces() ^ pieces_cp(Us, QUEEN))
-      : Pt == ROOK ? attacks_bb_rook(s, pieces() ^ pieces_cpp(Us, ROOK, QUEEN))
-                   : attacks_from(Pt, s);
+    b = Pt == BISHOP ? mobility_attacks_bishop(s, pieces() ^ pieces_cp(Us, QUEEN))
+      : Pt == ROOK   ? mobility_attacks_rook(s, pieces() ^ pieces_cpp(Us, ROOK, QUEEN))
+      : Pt == QUEEN  ? mobility_attacks_queen(s, pieces())
+                     : attacks_from_knight(s);
 
     if (pinned_pieces(pos, Us) & sq_bb(s))
       b &= LineBB[square_of(Us, KING)][s];
@@ -332,6 +375,8 @@ INLINE Score evaluate_piece(const Pos *pos, EvalInfo *ei, Score *mobility,
     }
   }
 
+  trace_add(Pt, Us, score);
+
   return score;
 }
 
@@ -466,6 +511,8 @@ INLINE Score evaluate_king(const Pos *pos, EvalInfo *ei, int Us)
   if (!(pieces_p(PAWN) & KingFlank[kf]))
     score -= PawnlessFlank;
 
+  trace_add(KING, Us, score);
+
   return score;
 }
 
@@ -560,6 +607,8 @@ INLINE Score evaluate_threats(const Pos *pos, EvalInfo *ei, const int Us)
 
   score += ThreatByPawnPush * popcount(b);
 
+  trace_add(TERM_THREAT, Us, score);
+
   return score;
 }
 
@@ -646,6 +695,8 @@ INLINE Score evaluate_passed_pawns(const Pos *pos, EvalInfo *ei, const int Us)
     score += make_score(mbonus, ebonus) + PassedFile[file_of(s)];
   }
 
+  trace_add(TERM_PASSED, Us, score);
+
   return score;
 }
 
@@ -683,8 +734,11 @@ INLINE Score evaluate_space(const Pos *pos, EvalInfo *ei, const int Us)
   // ...count safe + (behind & safe) with a single popcount.
   int bonus = popcount((Us == WHITE ? safe << 32 : safe >> 32) | (behind & safe));
   int weight = popcount(pieces_c(Us)) - 2 * ei->pe->openFiles;
+  Score score = make_score(bonus * weight * weight / 16, 0);
+
+  trace_add(TERM_SPACE, Us, score);
 
-  return make_score(bonus * weight * weight / 16, 0);
+  return score;
 }
 
 
@@ -775,9 +829,13 @@ Value evaluate(const Pos *pos)
   ei.pe = pawn_probe(pos);
   score += ei.pe->score;
 
+  trace_add(TERM_MATERIAL, WHITE, pos_psq_score());
+  trace_add(TERM_IMBALANCE, WHITE, material_imbalance(ei.me));
+  trace_add(PAWN, WHITE, ei.pe->score);
+
   // Early exit if score is high
   v = (mg_value(score) + eg_value(score)) / 2;
-  if (abs(v) > LazyThreshold)
+  if (abs(v) > LazyThreshold && !Tracing)
     return pos_stm() == WHITE ? v : -v;
 
   // Initialize attack and king safety bitboards.
@@ -788,6 +846,14 @@ Value evaluate(const Pos *pos)
   score += evaluate_pieces(pos, &ei, mobility);
   score += mobility[WHITE] - mobility[BLACK];
 
+  trace_add(TERM_MOBILITY, WHITE, mobility[WHITE]);
+  trace_add(TERM_MOBILITY, BLACK, mobility[BLACK]);
+
+  // Share the attack maps with see_test() at this node.
+  pos->st->attackedBy[WHITE] = ei.attackedBy[WHITE][0];
+  pos->st->attackedBy[BLACK] = ei.attackedBy[BLACK][0];
+  pos->st->attacksValid = 3;
+
   // Evaluate kings after all other pieces because we need full attack
   // information when computing the king safety evaluation.
   score +=  evaluate_king(pos, &ei, WHITE)
@@ -809,7 +875,11 @@ Value evaluate(const Pos *pos)
   // Evaluate position potential for the winning side
   //  score += evaluate_initiative(pos, ei.pi->asymmetry, eg_value(score));
   int eg = eg_value(score);
-  eg += evaluate_initiative(pos, ei.pe->asymmetry, eg);
+  Value initiative = evaluate_initiative(pos, ei.pe->asymmetry, eg);
+  eg += initiative;
+
+  trace_add(TERM_INITIATIVE, WHITE, make_score(0, initiative));
+  trace_add(TERM_TOTAL, WHITE, make_score(mg_value(score), eg));
 
   // Evaluate scale factor for the winning side
   //int sf = evaluate_scale_factor(pos, &ei, eg_value(score));
@@ -826,3 +896,202 @@ Value evaluate(const Pos *pos)
   return (pos_stm() == WHITE ? v : -v) + Tempo; // Side to move point of view
 }
 
+
+#ifdef TRACE
+
+static void trace_print_score(Score s)
+{
+  printf(" %5.2f %5.2f ", (double)mg_value(s) / PawnValueEg,
+                          (double)eg_value(s) / PawnValueEg);
+}
+
+static void trace_print_term(const char *name, int idx)
+{
+  printf("%15s |", name);
+  if (   idx == TERM_MATERIAL || idx == TERM_IMBALANCE || idx == PAWN
+      || idx == TERM_INITIATIVE || idx == TERM_TOTAL) {
+    printf("   ---   --- |   ---   --- |");
+    trace_print_score(TraceScores[idx][WHITE]);
+  } else {
+    trace_print_score(TraceScores[idx][WHITE]);
+    printf("|");
+    trace_print_score(TraceScores[idx][BLACK]);
+    printf("|");
+    trace_print_score(TraceScores[idx][WHITE] - TraceScores[idx][BLACK]);
+  }
+  printf("\n");
+}
+
+#endif
+
+// eval_trace() is like evaluate(), but instead of returning a value it
+// prints the evaluation from white's point of view. A build with trace=yes
+// also prints a table with the contribution of each term, unless the value
+// comes from a specialized endgame function.
+
+void eval_trace(const Pos *pos)
+{
+  if (pos_checkers()) {
+    printf("Total evaluation: none (in check)\n");
+    return;
+  }
+
+  if (material_specialized_eval_exists(material_probe(pos))) {
+    Value v = evaluate(pos);
+    v = pos_stm() == WHITE ? v : -v;
+    printf("Total evaluation: %.2f (white side)\n"
+           "(Evaluated by a specialized endgame function.)\n",
+           (double)v / PawnValueEg);
+    fflush(stdout);
+    return;
+  }
+
+#ifdef TRACE
+  memset(TraceScores, 0, sizeof(TraceScores));
+  Tracing = 1;
+  Value v = evaluate(pos);
+  Tracing = 0;
+
+  printf("      Eval term |    White    |    Black    |    Total\n"
+         "                |   MG    EG  |   MG    EG  |   MG    EG\n"
+         "----------------+-------------+-------------+-------------\n");
+  trace_print_term("Material", TERM_MATERIAL);
+  trace_print_term("Imbalance", TERM_IMBALANCE);
+  trace_print_term("Pawns", PAWN);
+  trace_print_term("Knights", KNIGHT);
+  trace_print_term("Bishops", BISHOP);
+  trace_print_term("Rooks", ROOK);
+  trace_print_term("Queens", QUEEN);
+  trace_print_term("Mobility", TERM_MOBILITY);
+  trace_print_term("King safety", KING);
+  trace_print_term("Threats", TERM_THREAT);
+  trace_print_term("Passed pawns", TERM_PASSED);
+  trace_print_term("Space", TERM_SPACE);
+  trace_print_term("Initiative", TERM_INITIATIVE);
+  printf("----------------+-------------+-------------+-------------\n");
+  trace_print_term("Total", TERM_TOTAL);
+  printf("\n");
+#else
+  Value v = evaluate(pos);
+#endif
+
+  v = pos_stm() == WHITE ? v : -v;
+  printf("Total evaluation: %.2f (white side)\n", (double)v / PawnValueEg);
+  fflush(stdout);
+}
+
+
+#ifdef TUNE
+
+EvalParam EvalParams[] = {
+  { "MobilityBonus", &MobilityBonus[0][0], 4 * 32 },
+  { "Outpost", &Outpost[0][0], 2 * 2 },
+  { "RookOnFile", RookOnFile, 2 },
+  { "ThreatByMinor", ThreatByMinor, 8 },
+  { "ThreatByRook", ThreatByRook, 8 },
+  { "ThreatByKing", ThreatByKing, 2 },
+  { "PassedFile", PassedFile, 8 },
+  { "KingProtector", KingProtector, 4 },
+  { "MinorBehindPawn", &MinorBehindPawn, 1 },
+  { "BishopPawns", &BishopPawns, 1 },
+  { "LongRangedBishop", &LongRangedBishop, 1 },
+  { "RookOnPawn", &RookOnPawn, 1 },
+  { "TrappedRook", &TrappedRook, 1 },
+  { "WeakQueen", &WeakQueen, 1 },
+  { "OtherCheck", &OtherCheck, 1 },
+  { "CloseEnemies", &CloseEnemies, 1 },
+  { "PawnlessFlank", &PawnlessFlank, 1 },
+  { "ThreatByHangingPawn", &ThreatByHangingPawn, 1 },
+  { "ThreatBySafePawn", &ThreatBySafePawn, 1 },
+  { "ThreatByRank", &ThreatByRank, 1 },
+  { "Hanging", &Hanging, 1 },
+  { "WeakUnopposedPawn", &WeakUnopposedPawn, 1 },
+  { "ThreatByPawnPush", &ThreatByPawnPush, 1 },
+  { "HinderPassedPawn", &HinderPassedPawn, 1 },
+  { "TrappedBishopA1H1", &TrappedBishopA1H1, 1 },
+  { NULL, NULL, 0 }
+};
+
+static EvalParam *ParamTables[] = { EvalParams, PawnParams };
+
+// eval_params_num() returns the length of the parameter vector, which
+// holds the middlegame and endgame values of each tunable Score.
+
+int eval_params_num(void)
+{
+  int n = 0;
+
+  for (int t = 0; t < 2; t++)
+    for (EvalParam *p = ParamTables[t]; p->name; p++)
+      n += 2 * p->num;
+
+  return n;
+}
+
+void eval_params_get(int *v)
+{
+  for (int t = 0; t < 2; t++)
+    for (EvalParam *p = ParamTables[t]; p->name; p++)
+      for (int i = 0; i < p->num; i++) {
+        *v++ = mg_value(p->score[i]);
+        *v++ = eg_value(p->score[i]);
+      }
+}
+
+// eval_params_set() installs a new parameter vector. The pawn hash tables
+// cache scores computed with the old values, so the caller has to clear
+// them before evaluating again.
+
+void eval_params_set(const int *v)
+{
+  for (int t = 0; t < 2; t++)
+    for (EvalParam *p = ParamTables[t]; p->name; p++)
+      for (int i = 0; i < p->num; i++, v += 2)
+        p->score[i] = make_score(v[0], v[1]);
+}
+
+// eval_params_print() writes the parameters as lines "name mg eg", with
+// an index appended to the name of array elements.
+
+void eval_params_print(FILE *f)
+{
+  for (int t = 0; t < 2; t++)
+    for (EvalParam *p = ParamTables[t]; p->name; p++)
+      for (int i = 0; i < p->num; i++) {
+        if (p->num > 1)
+          fprintf(f, "%s[%d]", p->name, i);
+        else
+          fprintf(f, "%s", p->name);
+        fprintf(f, " %d %d\n", mg_value(p->score[i]), eg_value(p->score[i]));
+      }
+}
+
+// eval_params_read() reads parameters in the format of eval_params_print()
+// and installs them. Nothing is changed if the names do not match.
+
+int eval_params_read(FILE *f)
+{
+  int n = eval_params_num();
+  int *v = malloc(n * sizeof(int)), *w = v;
+  char name[64], expected[64];
+
+  for (int t = 0; t < 2; t++)
+    for (EvalParam *p = ParamTables[t]; p->name; p++)
+      for (int i = 0; i < p->num; i++, w += 2) {
+        if (p->num > 1)
+          sprintf(expected, "%s[%d]", p->name, i);
+        else
+          sprintf(expected, "%s", p->name);
+        if (   fscanf(f, "%63s %d %d", name, &w[0], &w[1]) != 3
+            || strcmp(name, expected) != 0) {
+          free(v);
+          return 0;
+        }
+      }
+
+  eval_params_set(v);
+  free(v);
+  return 1;
+}
+
+#endif
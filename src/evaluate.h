@@ -1,13 +1,46 @@
 #ifndef EVALUATE_H
 #define EVALUATE_H
 
+#include <stdio.h>
+
 #include "types.h"
 
 typedef struct Pos Pos;
 
 #define Tempo ((Value)20)
 
+// With TUNE defined, the Score constants of evaluate.c and pawns.c are
+// variables that a tuner can change at runtime through eval_params_set().
+#ifdef TUNE
+#define TUNABLE static
+#else
+#define TUNABLE static const
+#endif
+
 Value evaluate(const Pos *pos);
+void eval_trace(const Pos *pos);
+
+#ifdef TUNE
+
+// EvalParam describes a named block of tunable Scores. The tables are
+// terminated by an entry with a NULL name.
+struct EvalParam {
+  const char *name;
+  Score *score;
+  int num;
+};
+
+typedef struct EvalParam EvalParam;
+
+extern EvalParam EvalParams[];
+extern EvalParam PawnParams[];
+
+int eval_params_num(void);
+void eval_params_get(int *v);
+void eval_params_set(const int *v);
+void eval_params_print(FILE *f);
+int eval_params_read(FILE *f);
 
 #endif
 
+#endif
@@ -0,0 +1,135 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2016 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// fat.c is the entry point of the fat binary built by 'make fat-build'.
+// The binary contains complete builds of the engine for several x86-64
+// levels and slider attack backends, each with main() and bitboards_time()
+// renamed and all other symbols made local. At startup we start the
+// variant best suited to the CPU:
+//
+// - by default the first variant in the list below that the CPU supports,
+//   skipping pext on AMD CPUs before Zen 3, where it is microcoded;
+// - with CFISH_VARIANT=timed the supported variant that performs slider
+//   attack lookups fastest;
+// - with CFISH_VARIANT=<name> the named variant.
+
+#include <cpuid.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main_bmi2(int argc, char **argv);
+int main_modern(int argc, char **argv);
+int main_black(int argc, char **argv);
+int main_x86_64(int argc, char **argv);
+
+uint64_t bitboards_time_bmi2(void);
+uint64_t bitboards_time_modern(void);
+uint64_t bitboards_time_black(void);
+uint64_t bitboards_time_x86_64(void);
+
+enum { CPU_POPCNT = 1, CPU_BMI2 = 2, CPU_SLOW_PEXT = 4 };
+
+struct Variant {
+  const char *name;
+  int (*main)(int, char **);
+  uint64_t (*time)(void);
+  int features;
+};
+
+static const struct Variant Variants[] = {
+  { "bmi2",   main_bmi2,   bitboards_time_bmi2,   CPU_POPCNT | CPU_BMI2 },
+  { "modern", main_modern, bitboards_time_modern, CPU_POPCNT },
+  { "black",  main_black,  bitboards_time_black,  CPU_POPCNT },
+  { "x86-64", main_x86_64, bitboards_time_x86_64, 0 }
+};
+
+#define NUM_VARIANTS (int)(sizeof(Variants) / sizeof(Variants[0]))
+
+static int cpu_features(void)
+{
+  unsigned eax, ebx, ecx, edx, family;
+  char vendor[13];
+  int features = 0;
+
+  if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx))
+    return 0;
+
+  memcpy(vendor, &ebx, 4);
+  memcpy(vendor + 4, &edx, 4);
+  memcpy(vendor + 8, &ecx, 4);
+  vendor[12] = 0;
+
+  unsigned maxLeaf = eax;
+
+  __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+  if (ecx & bit_POPCNT)
+    features |= CPU_POPCNT;
+
+  family = ((eax >> 8) & 0x0f) + ((eax >> 20) & 0xff);
+  if (strcmp(vendor, "AuthenticAMD") == 0 && family < 0x19)
+    features |= CPU_SLOW_PEXT;
+
+  if (maxLeaf >= 7) {
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    if (ebx & bit_BMI2)
+      features |= CPU_BMI2;
+  }
+
+  return features;
+}
+
+int main(int argc, char **argv)
+{
+  int features = cpu_features();
+  const char *choice = getenv("CFISH_VARIANT");
+  uint64_t bestTime = 0;
+  int best = -1;
+
+  for (int i = 0; i < NUM_VARIANTS; i++) {
+    if ((Variants[i].features & features) != Variants[i].features)
+      continue;
+
+    if (choice && strcmp(choice, "timed") == 0) {
+      uint64_t t = Variants[i].time();
+      fprintf(stderr, "%-8s %8" PRIu64 " us\n", Variants[i].name, t);
+      if (best < 0 || t < bestTime)
+        best = i, bestTime = t;
+    }
+    else if (choice) {
+      if (strcmp(choice, Variants[i].name) == 0)
+        best = i;
+    }
+    else if (   best < 0
+             && !((Variants[i].features & CPU_BMI2) && (features & CPU_SLOW_PEXT)))
+      best = i;
+  }
+
+  if (best < 0) {
+    fprintf(stderr, "No supported variant '%s'\n", choice ? choice : "");
+    return 1;
+  }
+
+  if (choice)
+    fprintf(stderr, "Starting variant %s\n", Variants[best].name);
+
+  return Variants[best].main(argc, argv);
+}
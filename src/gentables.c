@@ -0,0 +1,99 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2016 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bitboard.h"
+#include "position.h"
+#include "search.h"
+
+// The tables that take noticeable time to compute at startup: the slider
+// attacks of the selected backend, the KPK bitbase, the cuckoo tables and
+// the search reductions. Each entry gives the table and its element type.
+
+#define TABLES(X)                                  \
+  SLIDER_TABLES(X)                                 \
+  X(KPKBitbase, uint32_t)                          \
+  X(cuckoo, Key) X(cuckooMove, Move)               \
+  X(FutilityMoveCounts, int) X(Reductions, int)
+
+static void print_table(FILE *f, const char *name, const void *data,
+                        size_t num, size_t size, int isSigned)
+{
+  fprintf(f, "\n__typeof__(%s) %s = {", name, name);
+
+  for (size_t i = 0; i < num; i++) {
+    const char *p = (const char *)data + i * size;
+    uint64_t v =  size == 8 ? *(const uint64_t *)p
+                : size == 4 ? *(const uint32_t *)p
+                : size == 2 ? *(const uint16_t *)p : *(const uint8_t *)p;
+
+    fprintf(f, i % 8 ? " " : "\n  ");
+    if (!v)
+      fprintf(f, "0");
+    else if (size == 8)
+      fprintf(f, "0x%" PRIx64, v);
+    else if (isSigned)
+      fprintf(f, "%" PRId64, (int64_t)(v << (64 - 8 * size)) >> (64 - 8 * size));
+    else
+      fprintf(f, "%" PRIu64, v);
+    fprintf(f, i + 1 < num ? "," : "\n");
+  }
+
+  fprintf(f, "};\n");
+}
+
+// gentables() is called when the engine receives the "gentables" command.
+// It writes the tables listed above, as computed at startup, to a C source
+// file. 'make pregen-build' compiles that file into a binary built with
+// -DPREGEN, which then skips computing them.
+
+void gentables(char *str)
+{
+  char *fname = strtok(str, " \t\n");
+
+  if (!fname) {
+    printf("Usage: gentables <file>\n");
+    return;
+  }
+
+  FILE *f = fopen(fname, "w");
+  if (!f) {
+    printf("Unable to open file %s\n", fname);
+    return;
+  }
+
+  fprintf(f, "// Generated by 'cfish gentables'. Do not edit.\n\n");
+  fprintf(f, "#pragma GCC diagnostic ignored \"-Wmissing-braces\"\n\n");
+  fprintf(f, "#include \"bitboard.h\"\n");
+  fprintf(f, "#include \"position.h\"\n");
+  fprintf(f, "#include \"search.h\"\n");
+
+#define PRINT_TABLE(name, type)                                         \
+  print_table(f, #name, name, sizeof(name) / sizeof(type), sizeof(type), \
+              (type)-1 < (type)1);
+  TABLES(PRINT_TABLE)
+#undef PRINT_TABLE
+
+  fclose(f);
+  printf("Tables written to %s\n", fname);
+}
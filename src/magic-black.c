@@ -6,7 +6,9 @@ Bitboard  BishopMasks  [64];
 Bitboard  BishopMagics [64];
 Bitboard *BishopAttacks[64];
 
-static Bitboard AttacksTable[87988];
+#ifndef PREGEN
+Bitboard AttacksTable[87988];
+#endif
 
 // Black magics found by Volker Annuss and Niklas Fiekas
 // http://talkchess.com/forum/viewtopic.php?t=64790
@@ -167,6 +169,9 @@ static void init_magics(struct MagicInit *magic_init, Bitboard *attacks[],
 
     masks[s] = ~(m = sliding_attack(deltas, s, 0) & ~edges);
 
+    if (HasPregen)
+      continue;
+
     // Use Carry-Rippler trick to enumerate all subsets of m and
     // fill the attacks table.
     b = 0;
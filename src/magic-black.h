@@ -4,6 +4,10 @@ extern Bitboard BishopMasks[64];
 extern Bitboard BishopMagics[64];
 extern Bitboard *RookAttacks[64];
 extern Bitboard *BishopAttacks[64];
+extern Bitboard AttacksTable[87988];
+
+// Tables written out by 'make pregen-build'
+#define SLIDER_TABLES(X) X(AttacksTable, Bitboard)
 
 INLINE unsigned magic_index_bishop(Square s, Bitboard occupied)
 {
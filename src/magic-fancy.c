@@ -1,17 +1,23 @@
 #include "misc.h"
 
 Bitboard  RookMasks  [64];
+#ifndef PREGEN
 Bitboard  RookMagics [64];
+#endif
 Bitboard *RookAttacks[64];
 uint8_t   RookShifts [64];
 
 Bitboard  BishopMasks  [64];
+#ifndef PREGEN
 Bitboard  BishopMagics [64];
+#endif
 Bitboard *BishopAttacks[64];
 uint8_t   BishopShifts [64];
 
-static Bitboard RookTable[0x19000];  // To store rook attacks
-static Bitboard BishopTable[0x1480]; // To store bishop attacks
+#ifndef PREGEN
+Bitboard RookTable[0x19000];  // To store rook attacks
+Bitboard BishopTable[0x1480]; // To store bishop attacks
+#endif
 
 typedef unsigned (Fn)(Square, Bitboard);
 
@@ -40,6 +46,13 @@ static void init_magics(Bitboard table[], Bitboard *attacks[],
     masks[s]  = sliding_attack(deltas, s, 0) & ~edges;
     shifts[s] = (Is64Bit ? 64 : 32) - popcount(masks[s]);
 
+    // With pregenerated tables the magics and attacks are already known
+    if (HasPregen) {
+      if (s < 63)
+        attacks[s + 1] = attacks[s] + (1 << popcount(masks[s]));
+      continue;
+    }
+
     // Use Carry-Rippler trick to enumerate all subsets of masks[s] and
     // store the corresponding sliding attack bitboard in reference[].
     b = size = 0;
@@ -6,6 +6,12 @@ extern Bitboard BishopMagics[64];
 extern uint8_t  BishopShifts[64];
 extern Bitboard *RookAttacks[64];
 extern Bitboard *BishopAttacks[64];
+extern Bitboard RookTable[0x19000];
+extern Bitboard BishopTable[0x1480];
+
+// Tables written out by 'make pregen-build'
+#define SLIDER_TABLES(X) X(RookTable, Bitboard) X(BishopTable, Bitboard) \
+                         X(RookMagics, Bitboard) X(BishopMagics, Bitboard)
 
 // attacks_bb() returns a bitboard representing all the squares attacked
 // by a // piece of type Pt (bishop or rook) placed on 's'. The helper
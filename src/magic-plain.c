@@ -6,7 +6,9 @@ Bitboard  BishopMasks  [64];
 Bitboard  BishopMagics [64];
 Bitboard *BishopAttacks[64];
 
-static Bitboard AttacksTable[88772];
+#ifndef PREGEN
+Bitboard AttacksTable[88772];
+#endif
 
 // Fixed shift magics found by Volker Annuss.
 // From: http://talkchess.com/forum/viewtopic.php?p=727500#727500
@@ -167,6 +169,9 @@ static void init_magics(struct MagicInit *magic_init, Bitboard *attacks[],
 
     masks[s] = sliding_attack(deltas, s, 0) & ~edges;
 
+    if (HasPregen)
+      continue;
+
     // Use Carry-Rippler trick to enumerate all subsets of masks[s] and
     // fill the attacks table.
     b = 0;
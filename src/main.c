@@ -35,8 +35,8 @@ int main(int argc, char **argv)
   print_engine_info(0);
 
   psqt_init();
-  zob_init();
   bitboards_init();
+  zob_init();
   bitbases_init();
   search_init();
   pawn_init();
@@ -47,6 +47,7 @@ int main(int argc, char **argv)
   uci_loop(argc, argv);
 
   threads_exit();
+  tb_cancel_ranking();
   TB_free();
   options_free();
   tt_free();
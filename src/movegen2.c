@@ -119,6 +119,24 @@ INLINE ExtMove *generate_pawn_moves(const Pos *pos, ExtMove *list,
   Bitboard pawnsOn7    = pieces_cp(Us, PAWN) &  TRank7BB;
   Bitboard pawnsNotOn7 = pieces_cp(Us, PAWN) & ~TRank7BB;
 
+  // A pinned pawn may only move along the line through our king: it can
+  // push only if pinned on the king's file and capture only if the target
+  // square lies on the pin line.
+  Square ksq = square_of(Us, KING);
+  Bitboard pinned = pinned_pieces(pos, Us) & pieces_p(PAWN);
+  Bitboard canPush = ~pinned, canRight = ~pinned, canLeft = ~pinned;
+  if (unlikely(pinned)) {
+    canPush |= file_bb_s(ksq);
+    Bitboard b = pinned;
+    while (b) {
+      Square s = pop_lsb(&b);
+      if (shift_bb(Right, sq_bb(s)) & LineBB[ksq][s])
+        canRight |= sq_bb(s);
+      if (shift_bb(Left, sq_bb(s)) & LineBB[ksq][s])
+        canLeft |= sq_bb(s);
+    }
+  }
+
   Bitboard enemies = (Type == EVASIONS ? pieces_c(Them) & target:
                       Type == CAPTURES ? target : pieces_c(Them));
 
@@ -126,7 +144,7 @@ INLINE ExtMove *generate_pawn_moves(const Pos *pos, ExtMove *list,
   if (Type != CAPTURES) {
     emptySquares = (Type == QUIETS || Type == QUIET_CHECKS ? target : ~pieces());
 
-    Bitboard b1 = shift_bb(Up, pawnsNotOn7)   & emptySquares;
+    Bitboard b1 = shift_bb(Up, pawnsNotOn7 & canPush) & emptySquares;
     Bitboard b2 = shift_bb(Up, b1 & TRank3BB) & emptySquares;
 
     if (Type == EVASIONS) { // Consider only blocking squares
@@ -144,8 +162,8 @@ INLINE ExtMove *generate_pawn_moves(const Pos *pos, ExtMove *list,
       // don't generate captures. Note that a possible discovery check
       // promotion has been already generated amongst the captures.
       Bitboard dcCandidates = blockers_for_king(pos, Them);
-      if (pawnsNotOn7 & dcCandidates) {
-        Bitboard dc1 = shift_bb(Up, pawnsNotOn7 & dcCandidates) & emptySquares & ~file_bb_s(st->ksq);
+      if (pawnsNotOn7 & canPush & dcCandidates) {
+        Bitboard dc1 = shift_bb(Up, pawnsNotOn7 & canPush & dcCandidates) & emptySquares & ~file_bb_s(st->ksq);
         Bitboard dc2 = shift_bb(Up, dc1 & TRank3BB) & emptySquares;
 
         b1 |= dc1;
@@ -172,9 +190,9 @@ INLINE ExtMove *generate_pawn_moves(const Pos *pos, ExtMove *list,
     if (Type == EVASIONS)
       emptySquares &= target;
 
-    Bitboard b1 = shift_bb(Right, pawnsOn7) & enemies;
-    Bitboard b2 = shift_bb(Left , pawnsOn7) & enemies;
-    Bitboard b3 = shift_bb(Up   , pawnsOn7) & emptySquares;
+    Bitboard b1 = shift_bb(Right, pawnsOn7 & canRight) & enemies;
+    Bitboard b2 = shift_bb(Left , pawnsOn7 & canLeft ) & enemies;
+    Bitboard b3 = shift_bb(Up   , pawnsOn7 & canPush ) & emptySquares;
 
     while (b1)
       list = make_promotions(list, pop_lsb(&b1), pos->st->ksq, Type, Right);
@@ -188,8 +206,8 @@ INLINE ExtMove *generate_pawn_moves(const Pos *pos, ExtMove *list,
 
   // Standard and en-passant captures
   if (Type == CAPTURES || Type == EVASIONS || Type == NON_EVASIONS) {
-    Bitboard b1 = shift_bb(Right, pawnsNotOn7) & enemies;
-    Bitboard b2 = shift_bb(Left , pawnsNotOn7) & enemies;
+    Bitboard b1 = shift_bb(Right, pawnsNotOn7 & canRight) & enemies;
+    Bitboard b2 = shift_bb(Left , pawnsNotOn7 & canLeft ) & enemies;
 
     while (b1) {
       Square to = pop_lsb(&b1);
@@ -214,8 +232,17 @@ INLINE ExtMove *generate_pawn_moves(const Pos *pos, ExtMove *list,
 
       assert(b1);
 
-      while (b1)
-        (list++)->move = make_enpassant(pop_lsb(&b1), ep_square());
+      // Removing both pawns from the board may expose our king to a
+      // slider, so we test for that directly. This also takes care of
+      // pinned pawns.
+      while (b1) {
+        Square from = pop_lsb(&b1);
+        Bitboard occupied =  pieces() ^ sq_bb(from) ^ sq_bb(ep_square() - Up)
+                           ^ sq_bb(ep_square());
+        if (   !(attacks_bb_rook  (ksq, occupied) & pieces_cpp(Them, QUEEN, ROOK))
+            && !(attacks_bb_bishop(ksq, occupied) & pieces_cpp(Them, QUEEN, BISHOP)))
+          (list++)->move = make_enpassant(from, ep_square());
+      }
     }
   }
 
@@ -229,8 +256,15 @@ INLINE ExtMove *generate_moves(const Pos *pos, ExtMove *list, int us,
   assert(Pt != KING && Pt != PAWN);
 
   Square from;
+  Square ksq = square_of(us, KING);
+  Bitboard pinned = pinned_pieces(pos, us);
 
   loop_through_pieces(us, Pt, from) {
+    // A pinned knight cannot move, other pinned pieces only along the
+    // line through our king.
+    if (Pt == KNIGHT && (pinned & sq_bb(from)))
+      continue;
+
     if (Checks) {
       if (    (Pt == BISHOP || Pt == ROOK || Pt == QUEEN)
           && !(PseudoAttacks[Pt][from] & target & pos->st->checkSquares[Pt]))
@@ -242,6 +276,9 @@ INLINE ExtMove *generate_moves(const Pos *pos, ExtMove *list, int us,
 
     Bitboard b = attacks_from(Pt, from) & target;
 
+    if (Pt != KNIGHT && (pinned & sq_bb(from)))
+      b &= LineBB[ksq][from];
+
     if (Checks)
       b &= pos->st->checkSquares[Pt];
 
@@ -253,6 +290,25 @@ INLINE ExtMove *generate_moves(const Pos *pos, ExtMove *list, int us,
 }
 
 
+// generate_king_moves() adds the king moves to the squares in 'b' that are
+// not attacked by the opponent. When in check, the squares behind the king
+// on the lines of the slider checkers must already have been removed.
+
+INLINE ExtMove *generate_king_moves(const Pos *pos, ExtMove *list, Bitboard b)
+{
+  uint32_t us = pos_stm();
+  Square ksq = square_of(us, KING);
+
+  while (b) {
+    Square to = pop_lsb(&b);
+    if (!(attackers_to(to) & pieces_c(us ^ 1)))
+      (list++)->move = make_move(ksq, to);
+  }
+
+  return list;
+}
+
+
 INLINE ExtMove *generate_all(const Pos *pos, ExtMove *list, Bitboard target,
                              const int Us, const int Type)
 {
@@ -264,12 +320,8 @@ INLINE ExtMove *generate_all(const Pos *pos, ExtMove *list, Bitboard target,
   list = generate_moves(pos, list, Us, target, ROOK, Checks);
   list = generate_moves(pos, list, Us, target, QUEEN, Checks);
 
-  if (Type != QUIET_CHECKS && Type != EVASIONS) {
-    Square ksq = square_of(Us, KING);
-    Bitboard b = attacks_from_king(ksq) & target;
-    while (b)
-      (list++)->move = make_move(ksq, pop_lsb(&b));
-  }
+  if (Type != QUIET_CHECKS && Type != EVASIONS)
+    list = generate_king_moves(pos, list, attacks_from_king(square_of(Us, KING)) & target);
 
   if (Type != CAPTURES && Type != EVASIONS && can_castle_c(Us)) {
     if (is_chess960()) {
@@ -285,14 +337,16 @@ INLINE ExtMove *generate_all(const Pos *pos, ExtMove *list, Bitboard target,
 }
 
 
-// generate_captures() generates all pseudo-legal captures and queen
-// promotions.
+// All generators below produce legal moves only. Pinned pieces are
+// restricted to the line through our king using blockersForKing, king
+// moves are tested against the opponent's attacks and, when in check, the
+// other moves are restricted to blocking or capturing the checker.
+//
+// generate_captures() generates all legal captures and queen promotions.
 //
-// generate_quiets() generates all pseudo-legal non-captures and
-// underpromotions.
+// generate_quiets() generates all legal non-captures and underpromotions.
 //
-// generate_non_evasions() generates all pseudo-legal captures and
-// non-captures.
+// generate_non_evasions() generates all legal captures and non-captures.
 
 INLINE ExtMove *generate(const Pos *pos, ExtMove *list, const int Type)
 {
@@ -327,13 +381,15 @@ ExtMove *generate_non_evasions(const Pos *pos, ExtMove *list)
 }
 
 
-// generate_quiet_checks() generates all pseudo-legal non-captures and
-// knight underpromotions that give check.
+// generate_quiet_checks() generates all legal non-captures and knight
+// underpromotions that give check.
 ExtMove *generate_quiet_checks(const Pos *pos, ExtMove *list)
 {
   assert(!pos_checkers());
 
   uint32_t us = pos_stm();
+  Square ksq = square_of(us, KING);
+  Bitboard pinned = pinned_pieces(pos, us);
   Bitboard dc = discovered_check_candidates(pos);
 
   while (dc) {
@@ -345,8 +401,13 @@ ExtMove *generate_quiet_checks(const Pos *pos, ExtMove *list)
 
     Bitboard b = attacks_from(pt, from) & ~pieces();
 
-    if (pt == KING)
-      b &= ~PseudoAttacks[QUEEN][pos->st->ksq];
+    if (pt == KING) {
+      list = generate_king_moves(pos, list, b & ~PseudoAttacks[QUEEN][pos->st->ksq]);
+      continue;
+    }
+
+    if (pinned & sq_bb(from))
+      b &= LineBB[ksq][from];
 
     while (b)
       (list++)->move = make_move(from, pop_lsb(&b));
@@ -357,8 +418,8 @@ ExtMove *generate_quiet_checks(const Pos *pos, ExtMove *list)
 }
 
 
-// generate_evasions() generates all pseudo-legal check evasions when the
-// side to move is in check.
+// generate_evasions() generates all legal check evasions when the side to
+// move is in check.
 ExtMove *generate_evasions(const Pos *pos, ExtMove *list)
 {
   assert(pos_checkers());
@@ -368,18 +429,17 @@ ExtMove *generate_evasions(const Pos *pos, ExtMove *list)
   Bitboard sliderAttacks = 0;
   Bitboard sliders = pos_checkers() & ~pieces_pp(KNIGHT, PAWN);
 
-  // Find all the squares attacked by slider checkers. We will remove them
-  // from the king evasions in order to skip known illegal moves, which
-  // avoids any useless legality checks later on.
+  // Find all the squares attacked by slider checkers. The king itself
+  // still blocks these rays, so they are removed from the king evasions
+  // explicitly.
   while (sliders) {
     Square checksq = pop_lsb(&sliders);
     sliderAttacks |= LineBB[ksq][checksq] ^ sq_bb(checksq);
   }
 
   // Generate evasions for king, capture and non capture moves
-  Bitboard b = attacks_from_king(ksq) & ~pieces_c(us) & ~sliderAttacks;
-  while (b)
-      (list++)->move = make_move(ksq, pop_lsb(&b));
+  list = generate_king_moves(pos, list,
+                             attacks_from_king(ksq) & ~pieces_c(us) & ~sliderAttacks);
 
   if (more_than_one(pos_checkers()))
       return list; // Double check, only a king move can save the day
@@ -394,23 +454,9 @@ ExtMove *generate_evasions(const Pos *pos, ExtMove *list)
 
 
 // generate_legal() generates all the legal moves in the given position
-SMALL
 ExtMove *generate_legal(const Pos *pos, ExtMove *list)
 {
-  Bitboard pinned = pinned_pieces(pos, pos_stm());
-  Square ksq = square_of(pos_stm(), KING);
-  ExtMove *cur = list;
-
-  list = pos_checkers() ? generate_evasions(pos, list)
+  return pos_checkers() ? generate_evasions(pos, list)
                         : generate_non_evasions(pos, list);
-  while (cur != list)
-    if (   (pinned || from_sq(cur->move) == ksq
-                   || type_of_m(cur->move) == ENPASSANT)
-        && !is_legal(pos, cur->move))
-      cur->move = (--list)->move;
-    else
-      ++cur;
-
-  return list;
 }
 
@@ -112,7 +112,9 @@ static void score_evasions(const Pos *pos)
 }
 
 
-// next_move() returns the next pseudo-legal move to be searched.
+// next_move() returns the next legal move to be searched. The generated
+// moves are legal by construction, so only the TT move, the killers and
+// the countermove need an explicit legality test.
 
 Move next_move(const Pos *pos, int skipQuiets)
 {
@@ -138,7 +140,7 @@ Move next_move(const Pos *pos, int skipQuiets)
     while (st->cur < st->endMoves) {
       move = pick_best(st->cur++, st->endMoves);
       if (move != st->ttMove) {
-        if (see_test(pos, move, 0))
+        if (see_test_mp(pos, move, 0))
           return move;
 
         // Losing capture, move it to the beginning of the array.
@@ -150,7 +152,7 @@ Move next_move(const Pos *pos, int skipQuiets)
     // First killer move.
     move = st->mp_killers[0];
     if (move && move != st->ttMove && is_pseudo_legal(pos, move)
-             && !is_capture(pos, move))
+             && !is_capture(pos, move) && is_legal(pos, move))
       return move;
     /* fallthrough */
 
@@ -158,7 +160,7 @@ Move next_move(const Pos *pos, int skipQuiets)
     st->stage++;
     move = st->mp_killers[1]; // Second killer move.
     if (move && move != st->ttMove && is_pseudo_legal(pos, move)
-             && !is_capture(pos, move))
+             && !is_capture(pos, move) && is_legal(pos, move))
       return move;
     /* fallthrough */
 
@@ -167,7 +169,7 @@ Move next_move(const Pos *pos, int skipQuiets)
     move = st->countermove;
     if (move && move != st->ttMove && move != st->mp_killers[0]
              && move != st->mp_killers[1] && is_pseudo_legal(pos, move)
-             && !is_capture(pos, move))
+             && !is_capture(pos, move) && is_legal(pos, move))
       return move;
     /* fallthrough */
 
@@ -258,7 +260,7 @@ Move next_move(const Pos *pos, int skipQuiets)
   case ST_PROBCUT_2:
     while (st->cur < st->endMoves) {
       move = pick_best(st->cur++, st->endMoves);
-      if (move != st->ttMove && see_test(pos, move, st->threshold))
+      if (move != st->ttMove && see_test_mp(pos, move, st->threshold))
         return move;
     }
     break;
@@ -85,6 +85,8 @@ INLINE void mp_init(const Pos *pos, Move ttm, Depth depth)
 
   Stack *st = pos->st;
 
+  st->seeSquare = SQ_NONE;
+
   st->depth = depth;
 
   Square prevSq = to_sq((st-1)->currentMove);
@@ -94,7 +96,7 @@ INLINE void mp_init(const Pos *pos, Move ttm, Depth depth)
 
   st->stage = pos_checkers() ? ST_EVASIONS : ST_MAIN_SEARCH;
   st->ttMove = ttm;
-  if (!ttm || !is_pseudo_legal(pos, ttm)) {
+  if (!ttm || !is_pseudo_legal(pos, ttm) || !is_legal(pos, ttm)) {
     st->stage++;
     st->ttMove = 0;
   }
@@ -106,6 +108,8 @@ INLINE void mp_init_q(const Pos *pos, Move ttm, Depth depth, Square s)
 
   Stack *st = pos->st;
 
+  st->seeSquare = SQ_NONE;
+
   if (pos_checkers())
     st->stage = ST_EVASIONS;
   else if (depth > DEPTH_QS_NO_CHECKS)
@@ -119,7 +123,7 @@ INLINE void mp_init_q(const Pos *pos, Move ttm, Depth depth, Square s)
   }
 
   st->ttMove = ttm;
-  if (!ttm || !is_pseudo_legal(pos, ttm)) {
+  if (!ttm || !is_pseudo_legal(pos, ttm) || !is_legal(pos, ttm)) {
     st->stage++;
     st->ttMove = 0;
   }
@@ -131,13 +135,16 @@ INLINE void mp_init_pc(const Pos *pos, Move ttm, Value threshold)
 
   Stack *st = pos->st;
 
+  st->seeSquare = SQ_NONE;
+
   st->threshold = threshold;
 
   st->stage = ST_PROBCUT;
 
   // In ProbCut we generate captures with SEE higher than the given
   // threshold.
-  st->ttMove =   ttm && is_pseudo_legal(pos, ttm) && is_capture(pos, ttm)
+  st->ttMove =   ttm && is_pseudo_legal(pos, ttm) && is_legal(pos, ttm)
+              && is_capture(pos, ttm)
               && see_test(pos, ttm, threshold) ? ttm : 0;
   if (st->ttMove == 0) st->stage++;
 }
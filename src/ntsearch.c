@@ -21,6 +21,22 @@ Value search_NonPV(Pos *pos, Stack *ss, Value alpha, Depth depth, int cutNode)
   assert(DEPTH_ZERO < depth && depth < DEPTH_MAX);
   assert(!(PvNode && cutNode));
 
+  // Check whether the side to move has a reversible move that draws by
+  // repetition.
+  if (   !rootNode
+      && pos_rule50_count() >= 3
+      && alpha < DrawValue[pos_stm()]
+      && has_game_cycle(pos))
+  {
+#if PvNode
+    alpha = DrawValue[pos_stm()];
+    if (alpha >= beta)
+      return alpha;
+#else
+    return DrawValue[pos_stm()];
+#endif
+  }
+
   Move pv[MAX_PLY+1], quietsSearched[64];
   TTEntry *tte;
   Key posKey;
@@ -131,11 +147,11 @@ Value search_NonPV(Pos *pos, Stack *ss, Value alpha, Depth depth, int cutNode)
   }
 
   // Step 4a. Tablebase probe
-  if (!rootNode && TB_Cardinality) {
+  if (!rootNode && pos->tbCardinality) {
     int piecesCnt = popcount(pieces());
 
-    if (    piecesCnt <= TB_Cardinality
-        && (piecesCnt <  TB_Cardinality || depth >= TB_ProbeDepth)
+    if (    piecesCnt <= pos->tbCardinality
+        && (piecesCnt <  pos->tbCardinality || depth >= TB_ProbeDepth)
         &&  pos_rule50_count() == 0
         && !can_castle_any())
     {
@@ -183,6 +199,14 @@ Value search_NonPV(Pos *pos, Stack *ss, Value alpha, Depth depth, int cutNode)
         }
       }
     }
+
+    // Step 4b. Tablebase prefetch. One capture away from the tablebases,
+    // let the OS start reading the blocks that the captures will probe.
+    else if (   TB_Prefetch
+             && piecesCnt == pos->tbCardinality + 1
+             && depth - ONE_PLY >= TB_ProbeDepth
+             && !can_castle_any())
+      TB_prefetch_captures(pos);
   }
 
   // Step 5. Evaluate the position statically
@@ -289,16 +313,15 @@ Value search_NonPV(Pos *pos, Stack *ss, Value alpha, Depth depth, int cutNode)
 
     mp_init_pc(pos, ttMove, rbeta - ss->staticEval);
 
-    while ((move = next_move(pos, 0)))
-      if (is_legal(pos, move)) {
-        ss->currentMove = move;
-        ss->history = &(*pos->counterMoveHistory)[moved_piece(move)][to_sq(move)];
-        do_move(pos, move, gives_check(pos, ss, move));
-        value = -search_NonPV(pos, ss+1, -rbeta, rdepth, !cutNode);
-        undo_move(pos, move);
-        if (value >= rbeta)
-          return value;
-      }
+    while ((move = next_move(pos, 0))) {
+      ss->currentMove = move;
+      ss->history = &(*pos->counterMoveHistory)[moved_piece(move)][to_sq(move)];
+      do_move(pos, move, gives_check(pos, ss, move));
+      value = -search_NonPV(pos, ss+1, -rbeta, rdepth, !cutNode);
+      undo_move(pos, move);
+      if (value >= rbeta)
+        return value;
+    }
   }
 
   // Step 10. Internal iterative deepening (skipped when in check)
@@ -396,8 +419,7 @@ moves_loop: // When in check search starts from here.
     // result is lower than ttValue minus a margin then we extend the ttMove.
     if (    singularExtensionNode
         &&  move == ttMove
-        && !extension
-        &&  is_legal(pos, move))
+        && !extension)
     {
       Value rBeta = max(ttValue - 2 * depth / ONE_PLY, -VALUE_MATE);
       Depth d = (depth / (2 * ONE_PLY)) * ONE_PLY;
@@ -421,7 +443,7 @@ moves_loop: // When in check search starts from here.
     }
     else if (    givesCheck
              && !moveCountPruning
-             &&  see_test(pos, move, 0))
+             &&  see_test_mp(pos, move, 0))
       extension = ONE_PLY;
 
     // Calculate new depth for this move
@@ -462,26 +484,20 @@ moves_loop: // When in check search starts from here.
         // threshold at higher depths.
         if (   lmrDepth < 8
             && !extension
-            && !see_test(pos, move, -35 * lmrDepth * lmrDepth))
+            && !see_test_mp(pos, move, -35 * lmrDepth * lmrDepth))
           continue;
       }
 //      else if (   depth < 7 * ONE_PLY && ss->stage != ST_GOOD_CAPTURES
 //               && !see_test(pos, move, -35 * depth / ONE_PLY * depth / ONE_PLY))
       else if (    depth < 7 * ONE_PLY
                && !extension
-               && !see_test(pos, move, -PawnValueEg * (depth / ONE_PLY)))
+               && !see_test_mp(pos, move, -PawnValueEg * (depth / ONE_PLY)))
         continue;
     }
 
     // Speculative prefetch as early as possible
     prefetch(tt_first_entry(key_after(pos, move)));
 
-    // Check for legality just before making the move
-    if (!rootNode && !is_legal(pos, move)) {
-      ss->moveCount = --moveCount;
-      continue;
-    }
-
     if (move == ttMove && captureOrPromotion)
       ttCapture = 1;
 
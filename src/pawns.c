@@ -21,6 +21,7 @@
 #include <assert.h>
 
 #include "bitboard.h"
+#include "evaluate.h"
 #include "pawns.h"
 #include "position.h"
 #include "thread.h"
@@ -29,19 +30,19 @@
 #define S(mg, eg) make_score(mg, eg)
 
 // Isolated pawn penalty
-static const Score Isolated = S(13, 18);
+TUNABLE Score Isolated = S(13, 18);
 
 // Backward pawn penalty
-static const Score Backward = S(24, 12);
+TUNABLE Score Backward = S(24, 12);
 
 // Connected pawn bonus by opposed, phalanx, #support and rank
 static Score Connected[2][2][3][8];
 
 // Doubled pawn penalty
-static const Score Doubled = S(18,38);
+TUNABLE Score Doubled = S(18,38);
 
 // Lever bonus by rank
-static const Score Lever[8] = {
+TUNABLE Score Lever[8] = {
   S( 0,  0), S( 0,  0), S(0, 0), S(0, 0),
   S(17, 16), S(33, 32), S(0, 0), S(0, 0)
 };
@@ -107,7 +108,8 @@ INLINE Score pawn_evaluate(const Pos *pos, PawnEntry *e, const int Us)
 
   e->passedPawns[Us] = e->pawnAttacksSpan[Us] = e->weakUnopposed[Us] = 0;
   e->semiopenFiles[Us] = 0xFF;
-  e->kingSquares[Us] = SQ_NONE;
+  for (int i = 0; i < KING_SAFETY_SLOTS; i++)
+    e->kingKeys[Us][i] = 0xffff; // No king square
   e->pawnAttacks[Us] = shift_bb(Right, ourPawns) | shift_bb(Left, ourPawns);
   e->pawnsOnSquares[Us][BLACK] = popcount(ourPawns & DarkSquares);
   e->pawnsOnSquares[Us][WHITE] = popcount(ourPawns & LightSquares);
@@ -255,14 +257,10 @@ INLINE Value shelter_storm(const Pos *pos, Square ksq, const int Us)
 }
 
 
-// do_king_safety() calculates a bonus for king safety. It is called only
-// when king square changes, which is about 20% of total king_safety() calls.
+// compute_king_safety() calculates a bonus for king safety.
 
-INLINE Score do_king_safety(PawnEntry *pe, const Pos *pos, Square ksq,
-                                   const int Us)
+INLINE Score compute_king_safety(const Pos *pos, Square ksq, const int Us)
 {
-  pe->kingSquares[Us] = ksq;
-  pe->castlingRights[Us] = can_castle_c(Us);
   int minKingPawnDistance = 0;
 
   Bitboard pawns = pieces_cp(Us, PAWN);
@@ -281,6 +279,35 @@ INLINE Score do_king_safety(PawnEntry *pe, const Pos *pos, Square ksq,
   return make_score(bonus, -16 * minKingPawnDistance);
 }
 
+// do_king_safety() is called when the king square or castling rights
+// differ from the most recently used slot of the pawn entry. It looks in
+// the other slots before computing the bonus, which helps when kings
+// shuffle between a few squares, and moves the result to the front.
+
+INLINE Score do_king_safety(PawnEntry *pe, const Pos *pos, Square ksq,
+                            const int Us)
+{
+  uint16_t key = king_key(pos, ksq, Us);
+  Score score;
+  int i;
+
+  for (i = 1; i < KING_SAFETY_SLOTS - 1 && pe->kingKeys[Us][i] != key; i++) {}
+
+  if (pe->kingKeys[Us][i] == key)
+    score = pe->kingSafety[Us][i];
+  else
+    score = compute_king_safety(pos, ksq, Us);
+
+  for (; i > 0; i--) {
+    pe->kingKeys[Us][i] = pe->kingKeys[Us][i - 1];
+    pe->kingSafety[Us][i] = pe->kingSafety[Us][i - 1];
+  }
+  pe->kingKeys[Us][0] = key;
+  pe->kingSafety[Us][0] = score;
+
+  return score;
+}
+
 // "template" instantiation:
 Score do_king_safety_white(PawnEntry *pe, const Pos *pos, Square ksq)
 {
@@ -292,3 +319,13 @@ Score do_king_safety_black(PawnEntry *pe, const Pos *pos, Square ksq)
   return do_king_safety(pe, pos, ksq, BLACK);
 }
 
+
+#ifdef TUNE
+EvalParam PawnParams[] = {
+  { "Isolated", &Isolated, 1 },
+  { "Backward", &Backward, 1 },
+  { "Doubled", &Doubled, 1 },
+  { "Lever", Lever, 8 },
+  { NULL, NULL, 0 }
+};
+#endif
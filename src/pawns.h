@@ -28,27 +28,36 @@
 // Number of entries in the pawn hash table. Must be a power of 2.
 #define PAWN_ENTRIES 16384
 
+// Number of king positions per color for which the king safety is cached.
+#define KING_SAFETY_SLOTS 4
+
 // PawnEntry contains various information about a pawn structure. A lookup
 // to the pawn hash table (performed by calling the probe function) returns
-// a pointer to an Entry object.
+// a pointer to an Entry object. An entry takes exactly two cache lines and
+// the table is allocated at a cache line boundary, so that do_move() can
+// prefetch a whole entry with prefetch2().
 
 struct PawnEntry {
   Key key;
   Bitboard passedPawns[2];
   Bitboard pawnAttacks[2];
   Bitboard pawnAttacksSpan[2];
-  Score kingSafety[2];
   Score score;
-  uint8_t kingSquares[2];
-  uint8_t castlingRights[2];
+  // kingSafety[c][i] is the king safety of color c for the king square
+  // and castling rights packed in kingKeys[c][i], most recently used first.
+  Score kingSafety[2][KING_SAFETY_SLOTS];
+  uint16_t kingKeys[2][KING_SAFETY_SLOTS];
   uint8_t semiopenFiles[2];
   uint8_t weakUnopposed[2];
   uint8_t pawnsOnSquares[2][2]; // [color][light/dark squares]
   uint8_t asymmetry;
   uint8_t openFiles;
+  uint8_t padding[10];
 };
 
 typedef struct PawnEntry PawnEntry;
+
+_Static_assert(sizeof(PawnEntry) == 128, "PawnEntry must take two cache lines");
 typedef PawnEntry PawnTable[PAWN_ENTRIES];
 
 Score do_king_safety_white(PawnEntry *pe, const Pos *pos, Square ksq);
@@ -85,22 +94,28 @@ INLINE int pawns_on_same_color_squares(PawnEntry *pe, int c, Square s)
   return pe->pawnsOnSquares[c][!!(DarkSquares & sq_bb(s))];
 }
 
+// king_key() packs the king square and the castling rights of a color.
+// Castling rights of black are in bits 2-3, so both fit in 16 bits.
+
+INLINE uint16_t king_key(const Pos *pos, Square ksq, int c)
+{
+  return ksq | (can_castle_c(c) << 8);
+}
+
 INLINE Score king_safety_white(PawnEntry *pe, const Pos *pos, Square ksq)
 {
-  if (   pe->kingSquares[WHITE] == ksq
-      && pe->castlingRights[WHITE] == can_castle_c(WHITE))
-    return pe->kingSafety[WHITE];
+  if (pe->kingKeys[WHITE][0] == king_key(pos, ksq, WHITE))
+    return pe->kingSafety[WHITE][0];
   else
-    return pe->kingSafety[WHITE] = do_king_safety_white(pe, pos, ksq);
+    return do_king_safety_white(pe, pos, ksq);
 }
 
 INLINE Score king_safety_black(PawnEntry *pe, const Pos *pos, Square ksq)
 {
-  if (   pe->kingSquares[BLACK] == ksq
-      && pe->castlingRights[BLACK] == can_castle_c(BLACK))
-    return pe->kingSafety[BLACK];
+  if (pe->kingKeys[BLACK][0] == king_key(pos, ksq, BLACK))
+    return pe->kingSafety[BLACK][0];
   else
-    return pe->kingSafety[BLACK] = do_king_safety_black(pe, pos, ksq);
+    return do_king_safety_black(pe, pos, ksq);
 }
 
 void pawn_init();
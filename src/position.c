@@ -25,6 +25,17 @@ static int check_pos(Pos *pos);
 
 struct Zob zob;
 
+// Cuckoo tables with the keys and moves of all reversible moves, used to
+// detect upcoming repetitions. Each key is stored at one of two slots
+// given by H1() and H2().
+#ifndef PREGEN
+Key cuckoo[8192];
+Move cuckooMove[8192];
+#endif
+
+INLINE int H1(Key h) { return h & 0x1fff; }
+INLINE int H2(Key h) { return (h >> 16) & 0x1fff; }
+
 Key mat_key[16] = {
   0ULL,
   0x5ced000000000101ULL,
@@ -90,13 +101,10 @@ INLINE void move_piece(Pos *pos, uint32_t c, uint32_t piece, Square from, Square
 
 // Calculate CheckInfo data.
 
-INLINE void set_check_info(Pos *pos)
+INLINE void set_check_squares(Pos *pos)
 {
   Stack *st = pos->st;
 
-  st->blockersForKing[WHITE] = slider_blockers(pos, pieces_c(BLACK), square_of(WHITE, KING), &st->pinnersForKing[WHITE]);
-  st->blockersForKing[BLACK] = slider_blockers(pos, pieces_c(WHITE), square_of(BLACK, KING), &st->pinnersForKing[BLACK]);
-
   uint32_t them = pos_stm() ^ 1;
   st->ksq = square_of(them, KING);
 
@@ -106,6 +114,46 @@ INLINE void set_check_info(Pos *pos)
   st->checkSquares[ROOK]   = attacks_from_rook(st->ksq);
   st->checkSquares[QUEEN]  = st->checkSquares[BISHOP] | st->checkSquares[ROOK];
   st->checkSquares[KING]   = 0;
+
+  st->attacksValid = 0;
+}
+
+INLINE void set_check_info(Pos *pos)
+{
+  Stack *st = pos->st;
+
+  st->blockersForKing[WHITE] = slider_blockers(pos, pieces_c(BLACK), square_of(WHITE, KING), &st->pinnersForKing[WHITE]);
+  st->blockersForKing[BLACK] = slider_blockers(pos, pieces_c(WHITE), square_of(BLACK, KING), &st->pinnersForKing[BLACK]);
+
+  set_check_squares(pos);
+}
+
+// update_check_info() does the work of set_check_info() after a move that
+// changed only the squares in 'changed'. The blockers and pinners of a
+// king can only change if a changed square lies on a line through the
+// king, which includes the king itself having moved. Otherwise they are
+// copied from the previous state.
+
+INLINE void update_check_info(Pos *pos, Bitboard changed)
+{
+  Stack *st = pos->st;
+
+  for (uint32_t c = WHITE; c <= BLACK; c++) {
+    Square ksq = square_of(c, KING);
+    if ((PseudoAttacks[QUEEN][ksq] | sq_bb(ksq)) & changed)
+      st->blockersForKing[c] = slider_blockers(pos, pieces_c(c ^ 1), ksq, &st->pinnersForKing[c]);
+    else {
+      st->blockersForKing[c] = (st-1)->blockersForKing[c];
+      st->pinnersForKing[c] = (st-1)->pinnersForKing[c];
+    }
+#ifndef NDEBUG
+    Bitboard pinners;
+    assert(st->blockersForKing[c] == slider_blockers(pos, pieces_c(c ^ 1), ksq, &pinners));
+    assert(st->pinnersForKing[c] == pinners);
+#endif
+  }
+
+  set_check_squares(pos);
 }
 
 
@@ -173,18 +221,44 @@ void zob_init(void) {
 
   zob.side = prng_rand(&rng);
   zob.noPawns = prng_rand(&rng);
+
+  if (HasPregen)
+    return;
+
+  // Fill the cuckoo tables with the keys of all non-pawn moves between
+  // two squares on an empty board. A move and its reverse have the same
+  // key, so only the move with s1 < s2 is stored.
+#ifndef NDEBUG
+  int count = 0;
+#endif
+  for (int c = 0; c < 2; c++)
+    for (int pt = KNIGHT; pt <= KING; pt++)
+      for (Square s1 = 0; s1 < 64; s1++)
+        for (Square s2 = s1 + 1; s2 < 64; s2++)
+          if (PseudoAttacks[pt][s1] & sq_bb(s2)) {
+            int pc = make_piece(c, pt);
+            Move move = make_move(s1, s2);
+            Key key = zob.psq[pc][s1] ^ zob.psq[pc][s2] ^ zob.side;
+            int i = H1(key);
+            while (1) {
+              Key k = cuckoo[i]; cuckoo[i] = key; key = k;
+              Move m = cuckooMove[i]; cuckooMove[i] = move; move = m;
+              if (!move) break; // Arrived at an empty slot
+              i = (i == H1(key)) ? H2(key) : H1(key); // Push victim to its other slot
+            }
+#ifndef NDEBUG
+            count++;
+#endif
+          }
+  assert(count == 3668);
 }
 
 
-// pos_set() initializes the position object with the given FEN string.
-// This function is not very robust - make sure that input FENs are correct,
-// this is assumed to be the responsibility of the GUI.
+// pos_clear() empties the board and the current Stack entry before a new
+// position is set up.
 
-void pos_set(Pos *pos, char *fen, int isChess960)
+static void pos_clear(Pos *pos)
 {
-  unsigned char col, row, token;
-  Square sq = SQ_A8;
-
   Stack *st = pos->st;
   memset(pos, 0, offsetof(Pos, moveList));
   pos->st = st;
@@ -198,6 +272,32 @@ void pos_set(Pos *pos, char *fen, int isChess960)
   for (Square s = 0; s < 64; s++)
     CastlingRightsMask[s] = ANY_CASTLING;
 #endif
+}
+
+static void pos_put_piece(Pos *pos, Piece piece, Square sq)
+{
+#ifdef PEDANTIC
+  put_piece(pos, color_of(piece), piece, sq);
+#else
+  pos->board[sq] = piece;
+  pos->byTypeBB[0] |= sq_bb(sq);
+  pos->byTypeBB[type_of_p(piece)] |= sq_bb(sq);
+  pos->byColorBB[color_of(piece)] |= sq_bb(sq);
+#endif
+}
+
+
+// pos_set() initializes the position object with the given FEN string.
+// This function is not very robust - make sure that input FENs are correct,
+// this is assumed to be the responsibility of the GUI.
+
+void pos_set(Pos *pos, char *fen, int isChess960)
+{
+  unsigned char col, row, token;
+  Square sq = SQ_A8;
+
+  Stack *st = pos->st;
+  pos_clear(pos);
 
   // Piece placement
   while ((token = *fen++) && token != ' ') {
@@ -208,15 +308,7 @@ void pos_set(Pos *pos, char *fen, int isChess960)
     else {
       for (int piece = 0; piece < 16; piece++)
         if (PieceToChar[piece] == token) {
-#ifdef PEDANTIC
-          put_piece(pos, color_of(piece), piece, sq++);
-#else
-          pos->board[sq] = piece;
-          pos->byTypeBB[0] |= sq_bb(sq);
-          pos->byTypeBB[type_of_p(piece)] |= sq_bb(sq);
-          pos->byColorBB[color_of(piece)] |= sq_bb(sq);
-          sq++;
-#endif
+          pos_put_piece(pos, piece, sq++);
           break;
         }
     }
@@ -426,6 +518,144 @@ void pos_fen(const Pos *pos, char *str)
 }
 
 
+// packed_ok() checks that a PackedPos describes a position we can set up
+// and finds its castling rooks, indexed by the bit of the castling right.
+// Batch input may be corrupt or written by another program, so we check
+// the pieces, the pawn ranks, that the side not to move is not in check,
+// the en passant square and the castling rights.
+
+static int packed_ok(const PackedPos *pp, Square castlingRook[4])
+{
+  Bitboard bb[16] = { 0 };
+  Bitboard occ = pp->occupied;
+
+  if (popcount(occ) > 32)
+    return 0;
+
+  int i = 0;
+  for (Bitboard b = occ; b; i++) {
+    Square sq = pop_lsb(&b);
+    int pc = (pp->pieces[i / 2] >> (4 * (i & 1))) & 0x0f;
+    if ((pc & 7) < PAWN || (pc & 7) > KING)
+      return 0;
+    bb[pc] |= sq_bb(sq);
+  }
+
+  if (   popcount(bb[W_KING]) != 1 || popcount(bb[B_KING]) != 1
+      || popcount(bb[W_PAWN]) > 8 || popcount(bb[B_PAWN]) > 8
+      || ((bb[W_PAWN] | bb[B_PAWN]) & (Rank1BB | Rank8BB)))
+    return 0;
+
+  int us = pp->stmRule50 >> 7, them = us ^ 1;
+  Square ksq = lsb(bb[make_piece(them, KING)]);
+  if (   (attacks_from_pawn(ksq, them) & bb[make_piece(us, PAWN)])
+      || (attacks_from_knight(ksq) & bb[make_piece(us, KNIGHT)])
+      || (attacks_from_king(ksq) & bb[make_piece(us, KING)])
+      || (  attacks_bb_bishop(ksq, occ)
+          & (bb[make_piece(us, BISHOP)] | bb[make_piece(us, QUEEN)]))
+      || (  attacks_bb_rook(ksq, occ)
+          & (bb[make_piece(us, ROOK)] | bb[make_piece(us, QUEEN)])))
+    return 0;
+
+  // The en passant square must be on the 6th rank, with the pawn that just
+  // advanced two squares in front of it and empty squares behind it.
+  Square ep = pp->epSquare;
+  if (   ep
+      && (   ep > SQ_H8
+          || relative_rank_s(us, ep) != RANK_6
+          || !(bb[make_piece(them, PAWN)] & sq_bb(ep - pawn_push(us)))
+          || (occ & (sq_bb(ep) | sq_bb(ep + pawn_push(us))))))
+    return 0;
+
+  // The castling rook is the outermost rook on the back rank, on the side
+  // of the king given by the castling right.
+  if (pp->castlingRights & ~ANY_CASTLING)
+    return 0;
+  for (int cr = WHITE_OO; cr <= BLACK_OOO; cr <<= 1) {
+    if (!(pp->castlingRights & cr))
+      continue;
+    int c = cr >= BLACK_OO ? BLACK : WHITE;
+    Bitboard backRank = c == WHITE ? Rank1BB : Rank8BB;
+    Bitboard king = bb[make_piece(c, KING)];
+    if (!(king & backRank))
+      return 0;
+    Bitboard rooks = bb[make_piece(c, ROOK)] & backRank;
+    rooks &= cr & (WHITE_OO | BLACK_OO) ? ~((king << 1) - 1) : king - 1;
+    if (!rooks)
+      return 0;
+    castlingRook[lsb(cr)] =  cr & (WHITE_OO | BLACK_OO) ? msb(rooks)
+                                                        : lsb(rooks);
+  }
+
+  return 1;
+}
+
+// pos_set_packed() initializes the position object from a PackedPos. The
+// castling rooks are taken to be the outermost rooks on the back rank, as
+// for the K and Q letters of X-FEN. It returns 0 without setting up the
+// position if the record is not valid.
+
+int pos_set_packed(Pos *pos, const PackedPos *pp, int isChess960)
+{
+  Stack *st = pos->st;
+  Square castlingRook[4];
+
+  if (!packed_ok(pp, castlingRook))
+    return 0;
+
+  pos_clear(pos);
+
+  int i = 0;
+  for (Bitboard b = pp->occupied; b; i++) {
+    Square sq = pop_lsb(&b);
+    pos_put_piece(pos, (pp->pieces[i / 2] >> (4 * (i & 1))) & 0x0f, sq);
+  }
+
+  pos->sideToMove = pp->stmRule50 >> 7;
+
+  for (int cr = WHITE_OO; cr <= BLACK_OOO; cr <<= 1)
+    if (pp->castlingRights & cr)
+      set_castling_right(pos, cr >= BLACK_OO ? BLACK : WHITE,
+                         castlingRook[lsb(cr)]);
+
+  // En passant square. Ignore if no pawn capture is possible.
+  st->epSquare = pp->epSquare;
+  if (st->epSquare && !(attackers_to(st->epSquare) & pieces_cp(pos_stm(), PAWN)))
+    st->epSquare = 0;
+
+  st->rule50 = pp->stmRule50 & 0x7f;
+  pos->gamePly = pp->gamePly;
+
+  pos->chess960 = isChess960;
+  set_state(pos, st);
+
+  assert(pos_is_ok(pos, &failed_step));
+
+  return 1;
+}
+
+
+// pos_pack() stores the position in a PackedPos. The result and score
+// fields are left untouched.
+
+void pos_pack(const Pos *pos, PackedPos *pp)
+{
+  pp->occupied = pieces();
+  memset(pp->pieces, 0, sizeof(pp->pieces));
+
+  int i = 0;
+  for (Bitboard b = pieces(); b; i++) {
+    Square sq = pop_lsb(&b);
+    pp->pieces[i / 2] |= piece_on(sq) << (4 * (i & 1));
+  }
+
+  pp->castlingRights = pos->st->castlingRights;
+  pp->epSquare = ep_square();
+  pp->stmRule50 = (pos_stm() << 7) | min(pos_rule50_count(), 127);
+  pp->gamePly = pos_game_ply();
+}
+
+
 // Turning slider_blockers() into an inline function was slower, even
 // though it should only add a single slightly optimised copy to evaluate().
 #if 1
@@ -1078,7 +1308,11 @@ void do_move(Pos *pos, Move m, int givesCheck)
   pos->sideToMove ^= 1;
   pos->nodes++;
 
-  set_check_info(pos);
+  if (unlikely(type_of_m(m) == CASTLING))
+    set_check_info(pos);
+  else
+    update_check_info(pos,  sq_bb(from) | sq_bb(to)
+                          | (type_of_m(m) == ENPASSANT ? sq_bb(to - pawn_push(us)) : 0));
 
   assert(pos_is_ok(pos, &failed_step));
 }
@@ -1176,7 +1410,7 @@ void do_null_move(Pos *pos)
 
   pos->sideToMove ^= 1;
 
-  set_check_info(pos);
+  update_check_info(pos, 0);
 
   assert(pos_is_ok(pos, &failed_step));
 }
@@ -1203,26 +1437,49 @@ Key key_after(const Pos *pos, Move m)
 }
 
 
-// Test whether SEE >= value.
-int see_test(const Pos *pos, Move m, int value)
+// see_early() decides the capture m without looking at the exchange if
+// possible. It returns 1 or 0 for a decided capture and -1 otherwise, in
+// which case 'swap' is set up for see_swap().
+
+INLINE int see_early(const Pos *pos, Move m, int value, int *swap)
 {
   if (unlikely(type_of_m(m) != NORMAL))
     return 0 >= value;
 
   Square from = from_sq(m), to = to_sq(m);
-  Bitboard occ;
 
-  int swap = PieceValue[MG][piece_on(to)] - value;
-  if (swap < 0)
+  *swap = PieceValue[MG][piece_on(to)] - value;
+  if (*swap < 0)
     return 0;
 
-  swap = PieceValue[MG][piece_on(from)] - swap;
-  if (swap <= 0)
+  *swap = PieceValue[MG][piece_on(from)] - *swap;
+  if (*swap <= 0)
     return 1;
 
-  occ = pieces() ^ sq_bb(from) ^ sq_bb(to);
   uint32_t stm = color_of(piece_on(from));
-  Bitboard attackers = attackers_to_occ(to, occ), stmAttackers;
+
+  // If evaluate() has left its attack maps for this node, the opponent does
+  // not attack 'to' and no opponent slider is lined up behind 'from', the
+  // capture cannot be answered. Pinned pieces are excluded from the maps,
+  // so 'from' must not be the pinner.
+  if (   (pos->st->attacksValid & (1 << (stm ^ 1)))
+      && !(pos->st->attackedBy[stm ^ 1] & sq_bb(to))
+      && !(LineBB[from][to] & pieces_c(stm ^ 1) & (pieces_pp(BISHOP, ROOK) | pieces_p(QUEEN)))
+      && !(pos->st->pinnersForKing[stm ^ 1] & sq_bb(from)))
+    return 1;
+
+  return -1;
+}
+
+// see_swap() resolves the exchange on 'to' after the first capture with
+// the given attackers and occupancy. 'swap' is the amount by which the
+// capture still exceeds the threshold from the point of view of 'stm', the
+// side that made the first capture.
+
+INLINE int see_swap(const Pos *pos, Square to, Bitboard occ,
+                    Bitboard attackers, uint32_t stm, int swap)
+{
+  Bitboard stmAttackers;
   int res = 1;
 
   while (1) {
@@ -1267,6 +1524,55 @@ int see_test(const Pos *pos, Move m, int value)
   return res;
 }
 
+// Test whether SEE >= value.
+int see_test(const Pos *pos, Move m, int value)
+{
+  int swap, res = see_early(pos, m, value, &swap);
+  if (res >= 0)
+    return res;
+
+  Square from = from_sq(m), to = to_sq(m);
+  Bitboard occ = pieces() ^ sq_bb(from) ^ sq_bb(to);
+
+  return see_swap(pos, to, occ, attackers_to_occ(to, occ),
+                  color_of(piece_on(from)), swap);
+}
+
+// see_test_mp() is see_test() for the moves of a node whose move picker
+// has been initialized. The attackers of the last target square are kept
+// in the move picker data, so that another capture on the same square
+// only adds the sliders it uncovers behind its from square. They are
+// computed lazily, when the swap loop is actually needed.
+
+int see_test_mp(const Pos *pos, Move m, int value)
+{
+  int swap, res = see_early(pos, m, value, &swap);
+  if (res >= 0)
+    return res;
+
+  Stack *st = pos->st;
+  Square from = from_sq(m), to = to_sq(m);
+  Bitboard occ = pieces() ^ sq_bb(from) ^ sq_bb(to);
+
+  if (st->seeSquare != to) {
+    st->seeSquare = to;
+    st->seeAttackers = attackers_to(to);
+  }
+
+  Bitboard attackers = st->seeAttackers;
+  if (LineBB[from][to] & (pieces_pp(BISHOP, ROOK) | pieces_p(QUEEN)) & ~sq_bb(from)) {
+    if (PseudoAttacks[BISHOP][to] & sq_bb(from))
+      attackers |= attacks_bb_bishop(to, occ) & pieces_pp(BISHOP, QUEEN);
+    else
+      attackers |= attacks_bb_rook(to, occ) & pieces_pp(ROOK, QUEEN);
+  }
+
+  res = see_swap(pos, to, occ, attackers, color_of(piece_on(from)), swap);
+  assert(res == see_test(pos, m, value));
+
+  return res;
+}
+
 
 #if 0
 // see_ab() performs an exact SEE calculation within bounds alpha and beta.
@@ -1420,6 +1726,48 @@ int is_draw(const Pos *pos)
 }
 
 
+// has_game_cycle() tests whether the side to move has a reversible move
+// to a position that occurred earlier in the line. The move keys are
+// looked up in the cuckoo tables, so this costs about as much as the scan
+// in is_draw().
+//
+// Unlike Stockfish we need not distinguish cycles that reach back beyond
+// the root: position() has already cleared the keys of positions before
+// the root that did not repeat, so a cycle through them is not found.
+
+int has_game_cycle(const Pos *pos)
+{
+  Stack *st = pos->st;
+  int end = st->pliesFromNull;
+
+  if (end < 3)
+    return 0;
+
+  Key originalKey = st->key;
+  Stack *stp = st - 1;
+
+  for (int i = 3; i <= end; i += 2) {
+    stp -= 2;
+    Key moveKey = originalKey ^ stp->key;
+    int j;
+    if (   (j = H1(moveKey), cuckoo[j] == moveKey)
+        || (j = H2(moveKey), cuckoo[j] == moveKey))
+    {
+      Move move = cuckooMove[j];
+      Square s1 = from_sq(move), s2 = to_sq(move);
+
+      // The path must be clear and the piece must belong to the side to
+      // move.
+      if (   !(between_bb(s1, s2) & pieces())
+          && color_of(piece_on(piece_on(s1) ? s1 : s2)) == pos_stm())
+        return 1;
+    }
+  }
+
+  return 0;
+}
+
+
 void pos_set_check_info(Pos *pos)
 {
   set_check_info(pos);
@@ -40,6 +40,8 @@ struct Zob {
 };
 
 extern struct Zob zob;
+extern Key cuckoo[8192];
+extern Move cuckooMove[8192];
 
 void psqt_init(void);
 void zob_init(void);
@@ -96,7 +98,9 @@ struct Stack {
   Move mp_killers[2];
   uint8_t stage;
   uint8_t recaptureSquare;
+  uint8_t seeSquare;
   ExtMove *cur, *endMoves, *endBadCaptures;
+  Bitboard seeAttackers; // Attackers of seeSquare, see see_test_mp()
 
   // CheckInfo data
   Bitboard blockersForKing[2];
@@ -110,6 +114,10 @@ struct Stack {
     };
   };
   Square ksq;
+
+  // Attack maps left by evaluate() for see_test(), valid per color
+  Bitboard attackedBy[2];
+  uint8_t attacksValid;
 };
 
 typedef struct Stack Stack;
@@ -154,6 +162,8 @@ struct Pos {
   uint64_t tb_hits;
   int PVIdx, PVLast;
   int selDepth;
+  int tbCardinality;
+  struct TTEntry *ttScratch; // Replaces the TT in batch_qsearch()
   Depth rootDepth;
   Depth completedDepth;
 
@@ -179,9 +189,26 @@ struct Pos {
 #endif
 };
 
+// PackedPos is a 32-byte position record for batch processing. The piece
+// codes are stored as nibbles in the order of the occupied squares.
+struct PackedPos {
+  Bitboard occupied;
+  uint8_t pieces[16];
+  uint8_t castlingRights;
+  uint8_t epSquare;
+  uint8_t stmRule50;    // Side to move in bit 7, rule50 counter in bits 0-6
+  uint8_t result;       // 0 = black wins, 1 = draw, 2 = white wins
+  uint16_t gamePly;
+  int16_t score;
+};
+
+typedef struct PackedPos PackedPos;
+
 // FEN string input/output
 void pos_set(Pos *pos, char *fen, int isChess960);
 void pos_fen(const Pos *pos, char *fen);
+int pos_set_packed(Pos *pos, const PackedPos *pp, int isChess960);
+void pos_pack(const Pos *pos, PackedPos *pp);
 void print_pos(Pos *pos);
 
 //PURE Bitboard pos_attackers_to_occ(const Pos *pos, Square s, Bitboard occupied);
@@ -201,9 +228,11 @@ INLINE void undo_null_move(Pos *pos);
 // Static exchange evaluation
 PURE Value see_sign(const Pos *pos, Move m);
 PURE Value see_test(const Pos *pos, Move m, int value);
+int see_test_mp(const Pos *pos, Move m, int value);
 
 PURE Key key_after(const Pos *pos, Move m);
 PURE int is_draw(const Pos *pos);
+PURE int has_game_cycle(const Pos *pos);
 
 // Position representation
 #define pieces() (pos->byTypeBB[0])
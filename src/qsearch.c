@@ -60,7 +60,10 @@ Value name_NT_InCheck(qsearch)(Pos* pos, Stack* ss, Value alpha, BETA_ARG
 
   // Transposition table lookup
   posKey = pos_key();
-  tte = tt_probe(posKey, &ttHit);
+  if (likely(!pos->ttScratch))
+    tte = tt_probe(posKey, &ttHit);
+  else
+    tte = pos->ttScratch, ttHit = 0;
   ttMove = ttHit ? tte_move(tte) : 0;
   ttValue = ttHit ? value_from_tt(tte_value(tte), ss->ply) : VALUE_NONE;
 
@@ -135,7 +138,7 @@ Value name_NT_InCheck(qsearch)(Pos* pos, Stack* ss, Value alpha, BETA_ARG
         continue;
       }
 
-      if (futilityBase <= alpha && !see_test(pos, move, 1)) {
+      if (futilityBase <= alpha && !see_test_mp(pos, move, 1)) {
         bestValue = max(bestValue, futilityBase);
         continue;
       }
@@ -150,18 +153,12 @@ Value name_NT_InCheck(qsearch)(Pos* pos, Stack* ss, Value alpha, BETA_ARG
     // Don't search moves with negative SEE values
     if (  (!InCheck || evasionPrunable)
         &&  type_of_m(move) != PROMOTION
-        &&  !see_test(pos, move, 0))
+        &&  !see_test_mp(pos, move, 0))
       continue;
 
     // Speculative prefetch as early as possible
     prefetch(tt_first_entry(key_after(pos, move)));
 
-    // Check for legality just before making the move
-    if (!is_legal(pos, move)) {
-      moveCount--;
-      continue;
-    }
-
     ss->currentMove = move;
 
     // Make and search the move
@@ -18,11 +18,15 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#define _GNU_SOURCE
 #include <assert.h>
 #include <math.h>
+#include <stdlib.h>
 #include <string.h>   // For std::memset
 #include <stdio.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <time.h>
 
 #include "evaluate.h"
 #include "misc.h"
@@ -43,9 +47,23 @@ LimitsType Limits;
 
 int TB_Cardinality, TB_CardinalityDTM;
 int TB_RootInTB;
-int TB_UseRule50;
+int TB_UseRule50, TB_Prefetch;
 Depth TB_ProbeDepth;
 
+// The root moves are ranked with the tablebases on a helper thread while
+// the search starts without the ranking. See tb_merge_ranking().
+static Pos RankPos;
+static RootMoves RankMoves;
+static int RankInTB, RankActive;
+static int RankMerged[MAX_THREADS];
+static atomic_bool RankDone;
+static atomic_int RankCardinality;
+#ifndef __WIN32__
+static pthread_t RankThread;
+#else
+static HANDLE RankThread;
+#endif
+
 // Different node types, used as a template parameter
 
 #define NonPV 0
@@ -63,8 +81,10 @@ static const int razor_margin[4] = { 0, 570, 603, 554 };
 #define futility_margin(d) ((Value)(150 * (d) / ONE_PLY))
 
 // Futility and reductions lookup tables, initialized at startup
-static int FutilityMoveCounts[2][16]; // [improving][depth]
-static int Reductions[2][2][64][64];  // [pv][improving][depth][moveNumber]
+#ifndef PREGEN
+int FutilityMoveCounts[2][16]; // [improving][depth]
+int Reductions[2][2][64][64];  // [pv][improving][depth][moveNumber]
+#endif
 
 static const int CounterMovePruneThreshold = 0;
 
@@ -153,6 +173,8 @@ static void check_time(void);
 static void stable_sort(RootMove *rm, int num);
 static void uci_print_pv(Pos *pos, Depth depth, Value alpha, Value beta);
 static int extract_ponder_from_tt(RootMove *rm, Pos *pos);
+static int tb_merge_ranking(Pos *pos);
+static void tb_wait_ranking(int ms);
 
 static TimePoint lastInfoTime;
 
@@ -160,6 +182,11 @@ static TimePoint lastInfoTime;
 
 void search_init(void)
 {
+  lastInfoTime = now();
+
+  if (HasPregen)
+    return;
+
   for (int imp = 0; imp <= 1; imp++)
     for (int d = 1; d < 64; ++d)
       for (int mc = 1; mc < 64; ++mc) {
@@ -177,8 +204,6 @@ void search_init(void)
     FutilityMoveCounts[0][d] = (int)(2.4 + 0.74 * pow(d, 1.78));
     FutilityMoveCounts[1][d] = (int)(5.0 + 1.00 * pow(d, 2.00));
   }
-
-  lastInfoTime = now();
 }
 
 
@@ -207,47 +232,173 @@ void search_clear()
 
 // perft() is our utility to verify move generation. All the leaf nodes
 // up to the given depth are generated and counted, and the sum is returned.
+// The root moves are divided over the threads. Counts of subtrees are
+// cached in the memory of the transposition table, which is idle during
+// perft and is cleared again afterwards, and the last ply is counted with
+// generate_legal() without making the moves.
+
+// A PerftEntry stores the count and depth of a subtree in 'data', and the
+// position key xor'ed with 'data' in 'check', so that entries torn by
+// concurrent writes do not match.
+typedef struct {
+  uint64_t check;
+  uint64_t data;
+} PerftEntry;
+
+static PerftEntry *PerftTable;
+static size_t PerftMask;
+
+static Pos *PerftRoot;
+static ExtMove PerftMoves[MAX_MOVES];
+static uint64_t PerftCounts[MAX_MOVES];
+static int PerftNumMoves;
+static Depth PerftDepth;
+static atomic_int PerftNext;
+
+INLINE PerftEntry *perft_entry(Key key, Depth depth)
+{
+  return &PerftTable[(key ^ (depth * 0x9E3779B97F4A7C15ULL)) & PerftMask];
+}
 
-static uint64_t perft_helper(Pos *pos, Depth depth, uint64_t nodes)
+static uint64_t perft_count(Pos *pos, Depth depth)
 {
+  PerftEntry *pe = NULL;
+  Key key = pos_key();
+
+  if (depth >= 2 * ONE_PLY && PerftTable) {
+    pe = perft_entry(key, depth);
+    uint64_t data = pe->data;
+    if ((pe->check ^ data) == key && (data & 0xff) == (uint64_t)depth)
+      return data >> 8;
+  }
+
   ExtMove *m = (pos->st-1)->endMoves;
   ExtMove *last = pos->st->endMoves = generate_legal(pos, m);
+
+  if (depth == ONE_PLY)
+    return last - m;
+
+  uint64_t nodes = 0;
   for (; m < last; m++) {
     do_move(pos, m->move, gives_check(pos, pos->st, m->move));
-    if (depth == 0) {
-      nodes += generate_legal(pos, last) - last;
-    } else
-      nodes = perft_helper(pos, depth - ONE_PLY, nodes);
+    nodes += perft_count(pos, depth - ONE_PLY);
     undo_move(pos, m->move);
   }
+
+  if (pe) {
+    uint64_t data = (nodes << 8) | depth;
+    pe->data = data;
+    pe->check = key ^ data;
+  }
+
   return nodes;
 }
 
-uint64_t perft(Pos *pos, Depth depth)
+// perft_job() is run by every thread. The thread copies the root position
+// and takes root moves until none are left.
+
+static void perft_job(Pos *pos)
+{
+  memcpy(pos, PerftRoot, offsetof(Pos, moveList));
+  pos->st = pos->stack + 5;
+  memcpy(pos->st, PerftRoot->st, StateSize);
+  (pos->st-1)->endMoves = pos->moveList;
+  pos->st->endMoves = pos->moveList;
+  pos_set_check_info(pos);
+
+  int i;
+  while ((i = atomic_fetch_add(&PerftNext, 1)) < PerftNumMoves) {
+    Move m = PerftMoves[i].move;
+    if (PerftDepth <= ONE_PLY)
+      PerftCounts[i] = 1;
+    else {
+      do_move(pos, m, gives_check(pos, pos->st, m));
+      PerftCounts[i] = perft_count(pos, PerftDepth - ONE_PLY);
+      undo_move(pos, m);
+    }
+  }
+}
+
+uint64_t perft(Pos *pos, Depth depth, int divide)
 {
-  uint64_t cnt, nodes = 0;
+  uint64_t nodes = 0;
   char buf[16];
 
-  ExtMove *m = pos->moveList;
-  ExtMove *last = pos->st->endMoves = generate_legal(pos, m);
-  for (; m < last; m++) {
-    if (depth <= ONE_PLY) {
-      cnt = 1;
-      nodes++;
-    } else {
-      do_move(pos, m->move, gives_check(pos, pos->st, m->move));
-      if (depth == 2 * ONE_PLY)
-        cnt = generate_legal(pos, last) - last;
-      else
-        cnt = perft_helper(pos, depth - 3 * ONE_PLY, 0);
-      nodes += cnt;
-      undo_move(pos, m->move);
-    }
-    printf("%s: %"PRIu64"\n", uci_move(buf, m->move, is_chess960()), cnt);
+  // Borrow the transposition table. Both sizes are powers of two, so the
+  // number of entries is as well.
+  _Static_assert(sizeof(Cluster) % sizeof(PerftEntry) == 0,
+                 "PerftEntry must divide Cluster");
+  tt_clear();
+  PerftTable = (PerftEntry *)TT.table;
+  PerftMask = (TT.mask + 1) * (sizeof(Cluster) / sizeof(PerftEntry)) - 1;
+
+  PerftRoot = pos;
+  PerftDepth = depth;
+  PerftNumMoves = generate_legal(pos, PerftMoves) - PerftMoves;
+  atomic_store(&PerftNext, 0);
+  threads_run_job(perft_job);
+
+  for (int i = 0; i < PerftNumMoves; i++) {
+    nodes += PerftCounts[i];
+    if (divide)
+      printf("%s: %"PRIu64"\n", uci_move(buf, PerftMoves[i].move, is_chess960()),
+             PerftCounts[i]);
   }
+  fflush(stdout);
+
+  PerftTable = NULL;
+  tt_clear();
+
   return nodes;
 }
 
+// batch_qsearch_init() prepares for calls to batch_qsearch(). The
+// histories are cleared so that results do not depend on earlier searches.
+// qsearch() only reads them, so they stay the same during the batch.
+
+void batch_qsearch_init(void)
+{
+  search_clear();
+  DrawValue[WHITE] = DrawValue[BLACK] = VALUE_DRAW;
+}
+
+// batch_qsearch() returns the quiescence search value of the position
+// from the point of view of the side to move. The search stack is set up
+// as in thread_search(), so that any thread can call it outside of a
+// regular search. The shared hash table is neither probed nor written:
+// qsearch() uses a scratch entry that is never hit instead, so that the
+// result of a position does not depend on the other positions or on the
+// order in which the threads search them.
+
+Value batch_qsearch(Pos *pos)
+{
+  Move pv[MAX_PLY + 1];
+  TTEntry scratch;
+
+  Stack *ss = pos->st; // At least the fifth element of the allocated array.
+  for (int i = -5; i < 3; i++)
+    memset(SStackBegin(ss[i]), 0, SStackSize);
+  (ss-1)->endMoves = pos->moveList;
+
+  for (int i = -4; i < 0; i++)
+    ss[i].history = &(*pos->counterMoveHistory)[0][0]; // Use as sentinel
+
+  for (int i = 0; i <= MAX_PLY; i++) {
+    ss[i].ply = i;
+    ss[i].skipEarlyPruning = 0;
+  }
+
+  ss->pv = pv;
+
+  pos->ttScratch = &scratch;
+  Value v = pos_checkers()
+           ? qsearch_PV_true(pos, ss, -VALUE_INFINITE, VALUE_INFINITE, DEPTH_ZERO)
+           : qsearch_PV_false(pos, ss, -VALUE_INFINITE, VALUE_INFINITE, DEPTH_ZERO);
+  pos->ttScratch = NULL;
+
+  return v;
+}
+
 // mainthread_search() is called by the main thread when the program
 // receives the UCI 'go' command. It searches from the root position and
 // outputs the "bestmove".
@@ -301,6 +452,31 @@ void mainthread_search(void)
     fflush(stdout);
   }
 
+  // Let a ranking that is still running finish, as long as the time for
+  // this move allows it: up to the maximum time with time management, up
+  // to movetime, and without a limit for depth, nodes and mate searches.
+  // A 'stop' from the GUI cancels it. Moves that were not searched to the
+  // end get their TB score.
+  if (RankActive)
+    tb_wait_ranking(  use_time_management() ? time_maximum() - time_elapsed()
+                    : Limits.movetime ? Limits.movetime - time_elapsed()
+                    : INT_MAX);
+  atomic_store(&TB_RootProbeStop, 1);
+
+  int lateRank = 0;
+  if (pos->rootMoves->size > 0 && atomic_load(&RankDone))
+    for (int idx = 0; idx < Threads.num_threads; idx++) {
+      Pos *p = Threads.pos[idx];
+      if (RankMerged[idx] || !tb_merge_ranking(p))
+        continue;
+      RootMoves *rm = p->rootMoves;
+      for (int i = 0; i < rm->size; i++)
+        if (rm->move[i].score == -VALUE_INFINITE)
+          rm->move[i].score = rm->move[i].TBScore;
+      stable_sort(rm->move, rm->size);
+      lateRank |= idx == 0;
+    }
+
   // When playing in 'nodes as time' mode, subtract the searched nodes from
   // the available ones before exiting.
   if (Limits.npmsec)
@@ -329,7 +505,7 @@ void mainthread_search(void)
 
   IO_LOCK;
   // Send new PV when needed
-  if (bestThread != pos)
+  if (bestThread != pos || lateRank)
     uci_print_pv(bestThread, bestThread->completedDepth,
                  -VALUE_INFINITE, VALUE_INFINITE);
 
@@ -401,6 +577,14 @@ void thread_search(Pos *pos)
               && pos->thread_idx == 0
               && pos->rootDepth / ONE_PLY > Limits.depth))
   {
+    // Once the tablebase ranking is ready, continue with the moves in
+    // their TB order. The completed iterations are kept: the scores of the
+    // previous iteration still serve as aspiration windows, and from now
+    // on each PV line only searches the moves of its TB rank.
+    if (   !RankMerged[pos->thread_idx]
+        && atomic_load_explicit(&RankDone, memory_order_acquire))
+      tb_merge_ranking(pos);
+
     // Distribute search depths across the threads
     if (pos->thread_idx) {
       int i = (pos->thread_idx - 1) % 20;
@@ -866,13 +1050,16 @@ static int extract_ponder_from_tt(RootMove *rm, Pos *pos)
   return rm->pv_size > 1;
 }
 
-void TB_rank_root_moves(Pos *pos, RootMoves *rm)
+// tb_root_settings() reads the tablebase options for a new search and
+// returns whether the root position is in the tablebases.
+
+static int tb_root_settings(Pos *pos)
 {
   TB_RootInTB = 0;
   TB_UseRule50 = option_value(OPT_SYZ_50_MOVE);
+  TB_Prefetch = option_value(OPT_SYZ_PREFETCH);
   TB_ProbeDepth = option_value(OPT_SYZ_PROBE_DEPTH) * ONE_PLY;
   TB_Cardinality = option_value(OPT_SYZ_PROBE_LIMIT);
-  int dtz_available = 1, dtm_available = 0;
 
   if (TB_Cardinality > TB_MaxCardinality) {
     TB_Cardinality = TB_MaxCardinality;
@@ -883,35 +1070,169 @@ void TB_rank_root_moves(Pos *pos, RootMoves *rm)
                      ? min(TB_Cardinality, TB_MaxCardinalityDTM)
                      : 0;
 
-  if (TB_Cardinality >= popcount(pieces()) && !can_castle_any()) {
-    // Try ranking moves using DTZ tables.
-    TB_RootInTB = TB_root_probe_dtz(pos, rm);
+  return TB_Cardinality >= popcount(pieces()) && !can_castle_any();
+}
 
-    if (!TB_RootInTB) {
-      // DTZ tables are missing.
-      dtz_available = 0;
+// TB_rank_root_moves() ranks and sorts the root moves of a position in the
+// tablebases. It returns whether the ranking was successful and sets probe
+// to whether the search should still probe the tablebases.
 
-      // Try ranking moves using WDL tables as fallback.
-      TB_RootInTB = TB_root_probe_wdl(pos, rm);
-    }
+int TB_rank_root_moves(Pos *pos, RootMoves *rm, int *probe)
+{
+  int dtz_available = 1, dtm_available = 0;
+
+  // Try ranking moves using DTZ tables.
+  int inTB = TB_root_probe_dtz(pos, rm);
 
-    // If ranking was successful, try to obtain mate values from DTM tables.
-    if (TB_RootInTB && TB_CardinalityDTM >= popcount(pieces()))
-      dtm_available = TB_root_probe_dtm(pos, rm);
+  if (!inTB) {
+    // DTZ tables are missing.
+    dtz_available = 0;
+
+    // Try ranking moves using WDL tables as fallback.
+    inTB = TB_root_probe_wdl(pos, rm);
   }
 
-  if (TB_RootInTB) { // Ranking was successful.
+  // If ranking was successful, try to obtain mate values from DTM tables.
+  if (inTB && TB_CardinalityDTM >= popcount(pieces()))
+    dtm_available = TB_root_probe_dtm(pos, rm);
+
+  *probe = 1;
+  if (inTB) { // Ranking was successful.
     // Sort moves according to TB rank.
     stable_sort(rm->move, rm->size);
 
     // Only probe during search if DTM and DTZ are not available
     // and we are winning.
     if (dtm_available || dtz_available || rm->move[0].TBRank <= 0)
-      TB_Cardinality = 0;
+      *probe = 0;
   }
   else // Ranking was not successful.
     for (int i = 0; i < rm->size; i++)
       rm->move[i].TBRank = 0;
+
+  return inTB;
+}
+
+// With DTZ and DTM tables on a slow disk, ranking the root moves can take
+// a noticeable time. It is therefore done on a helper thread with its own
+// copy of the root position and moves, while the search starts with all
+// moves unranked. Each search thread merges the ranking into its root
+// moves at the start of its next iteration once the ranking is ready. If
+// the search ends first, mainthread_search() waits for it as long as the
+// time for the move allows and otherwise cancels it through
+// TB_RootProbeStop, which the root probes check between moves. A cancelled DTM probe leaves the DTZ ranking intact.
+
+#ifndef __WIN32__
+static void *rank_thread(void *arg)
+#else
+static DWORD WINAPI rank_thread(LPVOID arg)
+#endif
+{
+  (void)arg;
+
+  int probe;
+  RankInTB = TB_rank_root_moves(&RankPos, &RankMoves, &probe);
+  atomic_store(&RankCardinality, probe ? TB_Cardinality : 0);
+  atomic_store_explicit(&RankDone, 1, memory_order_release);
+
+  return 0;
+}
+
+static void tb_start_ranking(Pos *root, RootMoves *moves)
+{
+  if (!RankPos.stack) {
+    RankPos.stack = calloc((MAX_PLY + 110) * sizeof(Stack), 1);
+    RankPos.moveList = calloc(10000 * sizeof(ExtMove), 1);
+  }
+
+  memcpy(&RankPos, root, offsetof(Pos, moveList));
+  int n = max(5, root->st->pliesFromNull);
+  for (int i = 0; i <= n; i++)
+    memcpy(&RankPos.stack[i], &root->st[i - n], StateSize);
+  RankPos.st = RankPos.stack + n;
+  (RankPos.st-1)->endMoves = RankPos.moveList;
+  RankPos.pawnTable = threads_main()->pawnTable;
+  RankPos.materialTable = threads_main()->materialTable;
+  pos_set_check_info(&RankPos);
+
+  RankMoves.size = moves->size;
+  for (int i = 0; i < moves->size; i++)
+    RankMoves.move[i].pv[0] = moves->move[i].pv[0];
+
+  atomic_store(&RankDone, 0);
+  atomic_store(&TB_RootProbeStop, 0);
+  RankActive = 1;
+#ifndef __WIN32__
+  pthread_create(&RankThread, NULL, rank_thread, NULL);
+#else
+  RankThread = CreateThread(NULL, 0, rank_thread, NULL, 0, NULL);
+#endif
+}
+
+// tb_wait_ranking() waits at most ms milliseconds for the ranking to
+// become ready, or until the GUI sends 'stop'.
+
+static void tb_wait_ranking(int ms)
+{
+  TimePoint end = now() + ms;
+
+  while (   !atomic_load(&RankDone) && !Signals.stopCommand
+         && now() < end) {
+#ifndef __WIN32__
+    struct timespec ts = { 0, 1000000 };
+    nanosleep(&ts, NULL);
+#else
+    Sleep(1);
+#endif
+  }
+}
+
+// tb_cancel_ranking() stops the helper thread and waits for it to exit,
+// which takes at most the probe of one root move. It is called before the
+// next search and before the tablebases are freed.
+
+void tb_cancel_ranking(void)
+{
+  if (!RankActive)
+    return;
+
+  atomic_store(&TB_RootProbeStop, 1);
+#ifndef __WIN32__
+  pthread_join(RankThread, NULL);
+#else
+  WaitForSingleObject(RankThread, INFINITE);
+  CloseHandle(RankThread);
+#endif
+  RankActive = 0;
+}
+
+// tb_merge_ranking() copies the TB ranks and scores of the ranking into
+// the root moves of a thread and sorts them. It returns whether they were
+// ranked. The thread also takes over the probe limit set by the ranking.
+
+static int tb_merge_ranking(Pos *pos)
+{
+  RankMerged[pos->thread_idx] = 1;
+  if (!RankInTB)
+    return 0;
+
+  RootMoves *rm = pos->rootMoves;
+  for (int i = 0; i < rm->size; i++)
+    for (int j = 0; j < RankMoves.size; j++)
+      if (RankMoves.move[j].pv[0] == rm->move[i].pv[0]) {
+        rm->move[i].TBRank = RankMoves.move[j].TBRank;
+        rm->move[i].TBScore = RankMoves.move[j].TBScore;
+        break;
+      }
+  stable_sort(rm->move, rm->size);
+  pos->tbCardinality = atomic_load(&RankCardinality);
+
+  if (pos->thread_idx == 0) {
+    TB_RootInTB = 1;
+    pos->tb_hits += rm->size;
+  }
+
+  return 1;
 }
 
 
@@ -922,8 +1243,9 @@ void start_thinking(Pos *root)
 {
   if (Signals.searching)
     thread_wait_for_search_finished(threads_main());
+  tb_cancel_ranking();
 
-  Signals.stopOnPonderhit = Signals.stop = 0;
+  Signals.stopOnPonderhit = Signals.stop = Signals.stopCommand = 0;
 
   // Generate all legal moves.
   ExtMove list[MAX_MOVES];
@@ -943,17 +1265,25 @@ void start_thinking(Pos *root)
 
   RootMoves *moves = Threads.pos[0]->rootMoves;
   moves->size = end - list;
-  for (int i = 0; i < moves->size; i++)
+  for (int i = 0; i < moves->size; i++) {
     moves->move[i].pv[0] = list[i].move;
+    moves->move[i].TBRank = 0;
+    moves->move[i].TBScore = VALUE_ZERO;
+  }
 
-  // Rank root moves if root position is a TB position.
-  TB_rank_root_moves(root, moves);
+  // Rank root moves in the background if root position is a TB position.
+  memset(RankMerged, 0, sizeof(RankMerged));
+  RankInTB = 0;
+  atomic_store(&RankDone, 0);
+  if (tb_root_settings(root) && moves->size > 0)
+    tb_start_ranking(root, moves);
 
   for (int idx = 0; idx < Threads.num_threads; idx++) {
     Pos *pos = Threads.pos[idx];
     pos->selDepth = 0;
     pos->rootDepth = DEPTH_ZERO;
     pos->nodes = pos->tb_hits = 0;
+    pos->tbCardinality = TB_Cardinality;
     RootMoves *rm = pos->rootMoves;
     rm->size = end - list;
     for (int i = 0; i < rm->size; i++) {
@@ -975,9 +1305,6 @@ void start_thinking(Pos *root)
     pos_set_check_info(pos);
   }
 
-  if (TB_RootInTB)
-    Threads.pos[0]->tb_hits = end - list;
-
   Signals.searching = 1;
   thread_start_searching(threads_main(), 0);
 }
@@ -80,6 +80,7 @@ typedef struct LimitsType LimitsType;
 struct SignalsType {
   atomic_bool stop; // Search threads should stop searching.
   atomic_bool stopOnPonderhit; // Main search thread is willing to stop.
+  atomic_bool stopCommand; // The GUI sent 'stop' or 'quit'.
   int searching; // UI thread has started the main thread and has not yet
                  // called thread_wait_for_search_finished().
   int sleeping; // Main search thread is sleeping and must be woken up.
@@ -98,10 +99,16 @@ INLINE int use_time_management(void)
                        | Limits.infinite);
 }
 
+extern int FutilityMoveCounts[2][16];
+extern int Reductions[2][2][64][64];
+
 void search_init();
 void search_clear();
-uint64_t perft(Pos *pos, Depth depth);
+uint64_t perft(Pos *pos, Depth depth, int divide);
+void batch_qsearch_init(void);
+Value batch_qsearch(Pos *pos);
 void start_thinking(Pos *pos);
+void tb_cancel_ranking(void);
 
 #endif
 
@@ -7,6 +7,7 @@
   a particular engine, provided the engine is written in C or C++.
 */
 
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -14,14 +15,19 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #ifndef _WIN32
+#include <dirent.h>
+#include <errno.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
+#include <time.h>
 #endif
 #include "tbcore.h"
 
-#define TBMAX_PIECE 254
-#define TBMAX_PAWN 256
+#define TBMAX_PIECE 650
+#define TBMAX_PAWN 861
 #define HSHMAX 5
+#define LOOKUP_BITS 8
 
 #define Swap(a,b) {int tmp=a;a=b;b=tmp;}
 
@@ -47,27 +53,131 @@ static struct TBEntry_piece TB_piece[TBMAX_PIECE];
 static struct TBEntry_pawn TB_pawn[TBMAX_PAWN];
 static struct DTMEntry_piece DTM_piece[TBMAX_PIECE];
 static struct DTMEntry_pawn DTM_pawn[TBMAX_PAWN];
+static struct DTZEntry_piece DTZ_piece[TBMAX_PIECE];
+static struct DTZEntry_pawn DTZ_pawn[TBMAX_PAWN];
+static char piece_name[TBMAX_PIECE][16], pawn_name[TBMAX_PAWN][16];
 
 static struct TBHashEntry TB_hash[1 << TBHASHBITS][HSHMAX];
 
-#define DTZ_ENTRIES 64
-
-static struct DTZTableEntry DTZ_table[DTZ_ENTRIES];
-
 static void init_indices(void);
+static int init_table(struct TBEntry *entry, char *str, int dtm);
 static Key calc_key_from_pcs(int *pcs, int mirror);
 static Key calc_key_from_pieces(uint8_t *pieces, int num, int mirror);
 static void free_wdl_entry(struct TBEntry *entry);
 static void free_dtm_entry(struct TBEntry *entry);
 static void free_dtz_entry(struct TBEntry *entry);
+static void probe_cache_clear(void);
+
+// TB_files lists the tablebase files found in the SyzygyPath directories.
+// Each directory is scanned once by TB_init(), after which the tables of
+// all material combinations can be looked up without trying to open() a
+// file per table and directory. For each suffix, dir[] holds the index + 1
+// of the first directory containing the file. If a directory cannot be
+// listed, files_listed stays 0 and we fall back to opening files.
+
+#define TBFILES_BITS 13
+
+static const char *tb_suffix[] = { WDLSUFFIX, DTZSUFFIX, DTMSUFFIX };
+
+struct TBFile {
+  char name[16];
+  uint8_t dir[3];
+};
+
+static struct TBFile TB_files[1 << TBFILES_BITS];
+static int files_listed = 0;
+
+static struct TBFile *find_file(const char *name, int insert)
+{
+  uint32_t h = 2166136261u;
+  for (const char *s = name; *s; s++)
+    h = (h ^ (uint8_t)*s) * 16777619u;
+
+  for (int i = 0; i < (1 << TBFILES_BITS); i++) {
+    struct TBFile *f = &TB_files[(h + i) & ((1 << TBFILES_BITS) - 1)];
+    if (!f->name[0]) {
+      if (!insert) return NULL;
+      strcpy(f->name, name);
+      return f;
+    }
+    if (!strcmp(f->name, name))
+      return f;
+  }
+  return NULL;
+}
+
+static int add_file(const char *file, int d)
+{
+  size_t len = strlen(file);
+  char name[16];
+  int s;
+
+  for (s = 0; s < 3; s++) {
+    size_t l = strlen(tb_suffix[s]);
+    if (len > l && len - l < sizeof(name) && !strcmp(file + len - l, tb_suffix[s]))
+      break;
+  }
+  if (s == 3 || file[0] != 'K') return 1;
+
+  memcpy(name, file, len - strlen(tb_suffix[s]));
+  name[len - strlen(tb_suffix[s])] = 0;
+  struct TBFile *f = find_file(name, 1);
+  if (!f) return 0;
+  if (!f->dir[s])
+    f->dir[s] = (uint8_t)(d + 1);
+  return 1;
+}
+
+static int list_dir(int d)
+{
+  int ok = 1;
+#ifndef _WIN32
+  DIR *dir = opendir(paths[d]);
+  if (!dir)
+    return errno == ENOENT;
+  struct dirent *de;
+  while (ok && (de = readdir(dir)))
+    ok = add_file(de->d_name, d);
+  closedir(dir);
+#else
+  char pattern[256];
+  WIN32_FIND_DATA data;
+  snprintf(pattern, sizeof(pattern), "%s\\*.rtb?", paths[d]);
+  HANDLE h = FindFirstFile(pattern, &data);
+  if (h == INVALID_HANDLE_VALUE)
+    return   GetLastError() == ERROR_FILE_NOT_FOUND
+          || GetLastError() == ERROR_PATH_NOT_FOUND;
+  do
+    ok = add_file(data.cFileName, d);
+  while (ok && FindNextFile(h, &data));
+  FindClose(h);
+#endif
+  return ok;
+}
+
+static void list_files(void)
+{
+  memset(TB_files, 0, sizeof(TB_files));
+  files_listed = num_paths < 256;
+  for (int d = 0; files_listed && d < num_paths; d++)
+    files_listed = list_dir(d);
+}
 
 static FD open_tb(const char *str, const char *suffix)
 {
-  int i;
+  int i = 0;
   FD fd;
   char file[256];
 
-  for (i = 0; i < num_paths; i++) {
+  if (files_listed) {
+    int s = 0;
+    while (strcmp(suffix, tb_suffix[s])) s++;
+    struct TBFile *f = find_file(str, 0);
+    if (!f || !f->dir[s]) return FD_ERR;
+    i = f->dir[s] - 1;
+  }
+
+  for (; i < num_paths; i++) {
     strcpy(file, paths[i]);
     strcat(file, "/");
     strcat(file, str);
@@ -92,7 +202,8 @@ static void close_tb(FD fd)
 #endif
 }
 
-static void *map_file(const char *name, const char *suffix, uint64_t *mapping)
+static void *map_file(const char *name, const char *suffix, uint64_t *mapping,
+                      uint64_t *size)
 {
   FD fd = open_tb(name, suffix);
   if (fd == FD_ERR)
@@ -100,7 +211,7 @@ static void *map_file(const char *name, const char *suffix, uint64_t *mapping)
 #ifndef _WIN32
   struct stat statbuf;
   fstat(fd, &statbuf);
-  *mapping = statbuf.st_size;
+  *mapping = *size = statbuf.st_size;
   void *data = mmap(NULL, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
   if (data == MAP_FAILED) {
     fprintf(stderr, "Could not mmap() %s.\n", name);
@@ -109,6 +220,7 @@ static void *map_file(const char *name, const char *suffix, uint64_t *mapping)
 #else
   DWORD size_low, size_high;
   size_low = GetFileSize(fd, &size_high);
+  *size = ((uint64_t)size_high << 32) | size_low;
   HANDLE map = CreateFileMapping(fd, NULL, PAGE_READONLY, size_high, size_low,
                                   NULL);
   if (map == NULL) {
@@ -141,7 +253,347 @@ static void unmap_file(void *data, uint64_t mapping)
 }
 #endif
 
-static void add_to_hash(struct TBEntry *ptr, struct TBEntry *dtm_ptr, Key key)
+// With SyzygyMemoryLimit set, the tables that were probed recently are
+// kept "hot" within the limit. A table becomes hot on its first probe
+// after being cold. If that takes the hot tables over the limit, the hot
+// tables used least recently are released: their pages are dropped from
+// memory, but they stay mapped, so threads that are still probing them
+// simply fault the pages back in. The clock only advances when a table
+// becomes hot, so that ordinary probes only need to update a stamp.
+
+static uint64_t TB_MemLimit = 0;
+static uint64_t hot_bytes = 0, released_bytes = 0, pinned_bytes = 0;
+static int num_released = 0;
+static atomic_uint TB_clock;
+static atomic_uint TB_releases; // Invalidates PairsData.prefetched
+
+// tb_entry() returns the i-th of the 3 * (TBnum_piece + TBnum_pawn) WDL,
+// DTM and DTZ entries.
+static struct TBEntry *tb_entry(int i)
+{
+  if (i < TBnum_piece) return (struct TBEntry *)&TB_piece[i];
+  if ((i -= TBnum_piece) < TBnum_piece) return (struct TBEntry *)&DTM_piece[i];
+  if ((i -= TBnum_piece) < TBnum_piece) return (struct TBEntry *)&DTZ_piece[i];
+  if ((i -= TBnum_piece) < TBnum_pawn) return (struct TBEntry *)&TB_pawn[i];
+  if ((i -= TBnum_pawn) < TBnum_pawn) return (struct TBEntry *)&DTM_pawn[i];
+  return (struct TBEntry *)&DTZ_pawn[i - TBnum_pawn];
+}
+
+// tb_name() returns the name of the table of the i-th entry and sets type
+// to 0, 1 or 2 for a WDL, DTM or DTZ table.
+static char *tb_name(int i, int *type)
+{
+  if (i < 3 * TBnum_piece) {
+    *type = i / TBnum_piece;
+    return piece_name[i % TBnum_piece];
+  }
+  i -= 3 * TBnum_piece;
+  *type = i / TBnum_pawn;
+  return pawn_name[i % TBnum_pawn];
+}
+
+static void release_table(struct TBEntry *entry)
+{
+#ifndef _WIN32
+#ifdef MADV_PAGEOUT
+  if (madvise(entry->data, entry->size, MADV_PAGEOUT))
+#endif
+    madvise(entry->data, entry->size, MADV_DONTNEED);
+#else
+  // Unlocking pages that are not locked removes them from the working set.
+  VirtualUnlock(entry->data, entry->size);
+#endif
+  atomic_store_explicit(&entry->hot, 0, memory_order_relaxed);
+  atomic_fetch_add_explicit(&TB_releases, 1, memory_order_relaxed);
+  hot_bytes -= entry->size;
+  released_bytes += entry->size;
+  num_released++;
+}
+
+// Call with TB_mutex held.
+static void enforce_limit(struct TBEntry *keep)
+{
+  int n = 3 * (TBnum_piece + TBnum_pawn);
+
+  while (hot_bytes + pinned_bytes > TB_MemLimit) {
+    struct TBEntry *lru = NULL;
+    for (int i = 0; i < n; i++) {
+      struct TBEntry *e = tb_entry(i);
+      if (   e != keep && atomic_load_explicit(&e->hot, memory_order_relaxed) == 1
+          && (!lru || e->lru < lru->lru))
+        lru = e;
+    }
+    if (!lru) break;
+    release_table(lru);
+  }
+}
+
+static void make_hot(struct TBEntry *entry)
+{
+  LOCK(TB_mutex);
+  if (!atomic_load_explicit(&entry->hot, memory_order_relaxed)) {
+    atomic_store_explicit(&entry->lru, atomic_fetch_add(&TB_clock, 1) + 1,
+                          memory_order_relaxed);
+    atomic_store_explicit(&entry->hot, 1, memory_order_relaxed);
+    hot_bytes += entry->size;
+    enforce_limit(entry);
+  }
+  UNLOCK(TB_mutex);
+}
+
+// touch_table() is called on each probe of a table that is ready.
+INLINE void touch_table(struct TBEntry *entry)
+{
+  if (!TB_MemLimit)
+    return;
+  if (!atomic_load_explicit(&entry->hot, memory_order_relaxed))
+    make_hot(entry);
+  else {
+    unsigned c = atomic_load_explicit(&TB_clock, memory_order_relaxed);
+    if (atomic_load_explicit(&entry->lru, memory_order_relaxed) != c)
+      atomic_store_explicit(&entry->lru, c, memory_order_relaxed);
+  }
+}
+
+// TB_set_memory_limit() is called when SyzygyMemoryLimit is set. The
+// limit is in MB, 0 meaning no limit.
+void TB_set_memory_limit(int mb)
+{
+  if (path_string) LOCK(TB_mutex);
+
+  TB_MemLimit = (uint64_t)mb << 20;
+  int n = 3 * (TBnum_piece + TBnum_pawn);
+  if (!TB_MemLimit) {
+    for (int i = 0; i < n; i++)
+      if (atomic_load_explicit(&tb_entry(i)->hot, memory_order_relaxed) == 1)
+        atomic_store_explicit(&tb_entry(i)->hot, 0, memory_order_relaxed);
+    hot_bytes = 0;
+  } else
+    enforce_limit(NULL);
+
+  if (path_string) UNLOCK(TB_mutex);
+}
+
+// With SyzygyPreload set, the WDL and DTM tables up to a number of pieces
+// are loaded right after the tables are initialised and pinned in memory,
+// so that probing them never has to wait for the disk. A pinned table is
+// locked with mlock() where the limit on locked memory allows it and has
+// all its pages touched otherwise. Pinned tables count towards
+// SyzygyMemoryLimit, which also bounds how much is preloaded, but they
+// are never released to stay within it.
+
+// load_table() loads the i-th entry, which must be a WDL or DTM table, if
+// it has not been loaded yet. It returns 0 if the table cannot be loaded.
+// Call with TB_mutex held.
+static int load_table(int i)
+{
+  int type;
+  char *str = tb_name(i, &type);
+  struct TBEntry *entry = tb_entry(i);
+
+  struct TBHashEntry *ptr2 = TB_hash[entry->key >> (64 - TBHASHBITS)];
+  int j = 0;
+  while (j < HSHMAX && ptr2[j].key != entry->key) j++;
+  if (j == HSHMAX || (!type ? ptr2[j].ptr : ptr2[j].dtm_ptr) != entry)
+    return 0;
+
+  if (!atomic_load_explicit(&entry->ready, memory_order_relaxed)) {
+    if (!init_table(entry, str, type)) {
+      if (!type)
+        ptr2[j].key = 0ULL;
+      else {
+        entry->data = NULL;
+        ptr2[j].dtm_ptr = NULL;
+      }
+      return 0;
+    }
+    atomic_store_explicit(&entry->ready, 1, memory_order_release);
+  }
+
+  return 1;
+}
+
+// pin_table() loads and pins the i-th entry if it is a WDL or DTM table
+// of at most the given number of pieces. It returns the size pinned and
+// adds it to locked if the table could be locked.
+static uint64_t pin_table(int i, int pieces, uint64_t *locked)
+{
+  int type;
+  tb_name(i, &type);
+  struct TBEntry *entry = tb_entry(i);
+
+  if (type == 2 || entry->num > pieces)
+    return 0;
+
+  LOCK(TB_mutex);
+  if (!load_table(i)) {
+    UNLOCK(TB_mutex);
+    return 0;
+  }
+  int hot = atomic_load_explicit(&entry->hot, memory_order_relaxed);
+  if (hot == 2 || (TB_MemLimit && pinned_bytes + entry->size > TB_MemLimit)) {
+    UNLOCK(TB_mutex);
+    return 0;
+  }
+  if (hot == 1)
+    hot_bytes -= entry->size;
+  atomic_store_explicit(&entry->hot, 2, memory_order_relaxed);
+  pinned_bytes += entry->size;
+  UNLOCK(TB_mutex);
+
+#ifndef _WIN32
+  if (!mlock(entry->data, entry->size)) {
+#else
+  if (VirtualLock(entry->data, entry->size)) {
+#endif
+    *locked += entry->size;
+    return entry->size;
+  }
+  volatile uint8_t sum = 0;
+  for (uint64_t off = 0; off < entry->size; off += 4096)
+    sum += entry->data[off];
+
+  return entry->size;
+}
+
+// unpin_tables() unpins all pinned tables. Call with TB_mutex held.
+static void unpin_tables(void)
+{
+  int n = 3 * (TBnum_piece + TBnum_pawn);
+
+  for (int i = 0; i < n; i++) {
+    struct TBEntry *e = tb_entry(i);
+    if (atomic_load_explicit(&e->hot, memory_order_relaxed) != 2)
+      continue;
+#ifndef _WIN32
+    munlock(e->data, e->size);
+#else
+    VirtualUnlock(e->data, e->size);
+#endif
+    atomic_store_explicit(&e->hot, 0, memory_order_relaxed);
+  }
+  pinned_bytes = 0;
+}
+
+// resident_bytes() returns how much of a loaded table is resident in
+// memory, or its size where this cannot be determined.
+static uint64_t resident_bytes(struct TBEntry *e)
+{
+#ifndef _WIN32
+  static unsigned char vec[4096];
+  size_t page = sysconf(_SC_PAGESIZE);
+  uint64_t resident = 0;
+  for (uint64_t off = 0; off < e->size; off += sizeof(vec) * page) {
+    size_t len = min(e->size - off, sizeof(vec) * page);
+    if (mincore(e->data + off, len, vec)) return e->size;
+    for (size_t j = 0; j < (len + page - 1) / page; j++)
+      resident += (vec[j] & 1) * page;
+  }
+  return min(resident, e->size);
+#else
+  return e->size;
+#endif
+}
+
+// print_memory_stats() prints how much of the loaded tables is mapped
+// and resident in memory, and the number of major page faults of the
+// process so far.
+static void print_memory_stats(void)
+{
+  int n = 3 * (TBnum_piece + TBnum_pawn), loaded = 0, hot = 0, pinned = 0;
+  uint64_t mapped = 0, resident = 0;
+
+  for (int i = 0; i < n; i++) {
+    struct TBEntry *e = tb_entry(i);
+    if (!atomic_load_explicit(&e->ready, memory_order_acquire) || !e->data)
+      continue;
+    loaded++;
+    mapped += e->size;
+    hot += atomic_load_explicit(&e->hot, memory_order_relaxed) == 1;
+    pinned += atomic_load_explicit(&e->hot, memory_order_relaxed) == 2;
+    resident += resident_bytes(e);
+  }
+
+  printf("\nLoaded tables : %d, %.1f MB mapped", loaded, mapped / 1048576.0);
+#ifndef _WIN32
+  printf(", %.1f MB resident", resident / 1048576.0);
+#endif
+  if (pinned)
+    printf("\nPinned tables : %d, %.1f MB", pinned, pinned_bytes / 1048576.0);
+  if (TB_MemLimit)
+    printf("\nMemory limit  : %" PRIu64 " MB, %d tables hot (%.1f MB),"
+           " %d releases (%.1f MB)", TB_MemLimit >> 20, hot,
+           hot_bytes / 1048576.0, num_released, released_bytes / 1048576.0);
+#ifndef _WIN32
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  printf("\nMajor faults  : %ld", usage.ru_majflt);
+#endif
+  printf("\n");
+}
+
+// With SyzygyStats set, probes, probe cache hits and decompressions are
+// counted per table, and decompressions are timed. A decompression whose
+// block is not in the page cache, as told by mincore(), will wait for the
+// disk and is counted as cold.
+
+#define TB_HIST_BUCKETS 24
+
+struct TBStats {
+  atomic_uint_fast64_t probes, hits, reads, cold, nanos;
+};
+
+static struct TBStats TB_stats[3 * (TBMAX_PIECE + TBMAX_PAWN)];
+static atomic_uint_fast64_t DecodeHist[3][TB_HIST_BUCKETS];
+static int TB_StatsOn = 0;
+
+// tb_index() returns the index i of tb_entry(i) for an entry of the given
+// type, 0, 1 or 2 for WDL, DTM or DTZ.
+static int tb_index(struct TBEntry *e, int type)
+{
+  if (!e->has_pawns) {
+    int i =  type == 0 ? (struct TBEntry_piece *)e - TB_piece
+           : type == 1 ? (struct DTMEntry_piece *)e - DTM_piece
+           : (struct DTZEntry_piece *)e - DTZ_piece;
+    return type * TBnum_piece + i;
+  }
+  int i =  type == 0 ? (struct TBEntry_pawn *)e - TB_pawn
+         : type == 1 ? (struct DTMEntry_pawn *)e - DTM_pawn
+         : (struct DTZEntry_pawn *)e - DTZ_pawn;
+  return 3 * TBnum_piece + type * TBnum_pawn + i;
+}
+
+static void clear_stats(void)
+{
+  memset(TB_stats, 0, sizeof(TB_stats));
+  memset(DecodeHist, 0, sizeof(DecodeHist));
+}
+
+// TB_set_stats() is called when SyzygyStats is set. Enabling the
+// statistics starts them afresh.
+void TB_set_stats(int on)
+{
+  if (on && !TB_StatsOn)
+    clear_stats();
+  TB_StatsOn = on;
+}
+
+static uint64_t tb_nanos(void)
+{
+#ifndef _WIN32
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+  LARGE_INTEGER t, f;
+  QueryPerformanceCounter(&t);
+  QueryPerformanceFrequency(&f);
+  return (uint64_t)(t.QuadPart * (1e9 / f.QuadPart));
+#endif
+}
+
+static void add_to_hash(struct TBEntry *ptr, struct TBEntry *dtm_ptr,
+                        struct TBEntry *dtz_ptr, Key key)
 {
   int i, hshidx;
 
@@ -156,30 +608,38 @@ static void add_to_hash(struct TBEntry *ptr, struct TBEntry *dtm_ptr, Key key)
     TB_hash[hshidx][i].key = key;
     TB_hash[hshidx][i].ptr = ptr;
     TB_hash[hshidx][i].dtm_ptr = dtm_ptr;
+    TB_hash[hshidx][i].dtz_ptr = dtz_ptr;
+  }
+}
+
+static int test_tb(const char *str, const char *suffix)
+{
+  if (files_listed) {
+    int s = 0;
+    while (strcmp(suffix, tb_suffix[s])) s++;
+    struct TBFile *f = find_file(str, 0);
+    return f && f->dir[s];
   }
+
+  FD fd = open_tb(str, suffix);
+  if (fd == FD_ERR) return 0;
+  close_tb(fd);
+  return 1;
 }
 
 static char pchr[] = {'K', 'Q', 'R', 'B', 'N', 'P'};
 
 static void init_tb(char *str)
 {
-  FD fd;
-  struct TBEntry *entry, *dtm_entry;;
+  struct TBEntry *entry, *dtm_entry, *dtz_entry;
   int i, j, pcs[16];
   Key key, key2;
   int color;
   char *s;
 
-  fd = open_tb(str, WDLSUFFIX);
-  if (fd == FD_ERR) return;
-  close_tb(fd);
+  if (!test_tb(str, WDLSUFFIX)) return;
 
-  int dtm_present = 0;
-  fd = open_tb(str, DTMSUFFIX);
-  if (fd != FD_ERR) {
-    dtm_present = 1;
-    close_tb(fd);
-  }
+  int dtm_present = test_tb(str, DTMSUFFIX);
 
   for (i = 0; i < 16; i++)
     pcs[i] = 0;
@@ -218,24 +678,31 @@ static void init_tb(char *str)
       fprintf(stderr, "TBMAX_PIECE limit too low!\n");
       exit(EXIT_FAILURE);
     }
+    strcpy(piece_name[TBnum_piece], str);
     dtm_entry = (struct TBEntry *)&DTM_piece[TBnum_piece];
+    dtz_entry = (struct TBEntry *)&DTZ_piece[TBnum_piece];
     entry = (struct TBEntry *)&TB_piece[TBnum_piece++];
   } else {
     if (TBnum_pawn == TBMAX_PAWN) {
       fprintf(stderr, "TBMAX_PAWN limit too low!\n");
       exit(EXIT_FAILURE);
     }
+    strcpy(pawn_name[TBnum_pawn], str);
     dtm_entry = (struct TBEntry *)&DTM_pawn[TBnum_pawn];
+    dtz_entry = (struct TBEntry *)&DTZ_pawn[TBnum_pawn];
     entry = (struct TBEntry *)&TB_pawn[TBnum_pawn++];
   }
-  dtm_entry->key = entry->key = key;
-  dtm_entry->ready = entry->ready = 0;
+  dtz_entry->key = dtm_entry->key = entry->key = key;
+  dtz_entry->ready = dtm_entry->ready = entry->ready = 0;
+  dtz_entry->hot = dtm_entry->hot = entry->hot = 0;
+  dtz_entry->lru = dtm_entry->lru = entry->lru = 0;
   entry->num = 0;
   for (i = 0; i < 16; i++)
     entry->num += (uint8_t)pcs[i];
-  dtm_entry->num = entry->num;
-  dtm_entry->symmetric = entry->symmetric = (key == key2);
-  dtm_entry->has_pawns = entry->has_pawns = (pcs[TB_WPAWN] + pcs[TB_BPAWN] > 0);
+  dtz_entry->num = dtm_entry->num = entry->num;
+  dtz_entry->symmetric = dtm_entry->symmetric = entry->symmetric = (key == key2);
+  dtz_entry->has_pawns = dtm_entry->has_pawns = entry->has_pawns =
+                                      (pcs[TB_WPAWN] + pcs[TB_BPAWN] > 0);
   if (entry->num > TB_MaxCardinality)
     TB_MaxCardinality = entry->num;
   if (dtm_present && entry->num > TB_MaxCardinalityDTM)
@@ -253,6 +720,9 @@ static void init_tb(char *str)
     struct DTMEntry_pawn *ptr2 = (struct DTMEntry_pawn *)dtm_entry;
     ptr2->pawns[0] = ptr->pawns[0];
     ptr2->pawns[1] = ptr->pawns[1];
+    struct DTZEntry_pawn *ptr3 = (struct DTZEntry_pawn *)dtz_entry;
+    ptr3->pawns[0] = ptr->pawns[0];
+    ptr3->pawns[1] = ptr->pawns[1];
   } else {
     struct TBEntry_piece *ptr = (struct TBEntry_piece *)entry;
     for (i = 0, j = 0; i < 16; i++)
@@ -268,11 +738,13 @@ static void init_tb(char *str)
     }
     struct DTMEntry_piece *ptr2 = (struct DTMEntry_piece *)dtm_entry;
     ptr2->enc_type = ptr->enc_type;
+    struct DTZEntry_piece *ptr3 = (struct DTZEntry_piece *)dtz_entry;
+    ptr3->enc_type = ptr->enc_type;
   }
   if (!dtm_present)
     dtm_entry = NULL;
-  add_to_hash(entry, dtm_entry, key);
-  if (key2 != key) add_to_hash(entry, dtm_entry, key2);
+  add_to_hash(entry, dtm_entry, dtz_entry, key);
+  if (key2 != key) add_to_hash(entry, dtm_entry, dtz_entry, key2);
 }
 
 void TB_free(void)
@@ -283,7 +755,7 @@ void TB_free(void)
 void TB_init(char *path)
 {
   char str[16];
-  int i, j, k, l;
+  int i, j, k, l, m;
 
   if (!initialized) {
     init_indices();
@@ -294,30 +766,38 @@ void TB_init(char *path)
   if (path_string) {
     free(path_string);
     free(paths);
+    // Only tables that were loaded have anything to free. The others
+    // may still hold pointers from an earlier path.
     struct TBEntry *entry;
     for (i = 0; i < TBnum_piece; i++) {
       entry = (struct TBEntry *)&TB_piece[i];
-      free_wdl_entry(entry);
+      if (entry->ready) free_wdl_entry(entry);
       entry = (struct TBEntry *)&DTM_piece[i];
-      free_dtm_entry(entry);
+      if (entry->ready) free_dtm_entry(entry);
+      entry = (struct TBEntry *)&DTZ_piece[i];
+      if (entry->ready) free_dtz_entry(entry);
     }
     for (i = 0; i < TBnum_pawn; i++) {
       entry = (struct TBEntry *)&TB_pawn[i];
-      free_wdl_entry(entry);
+      if (entry->ready) free_wdl_entry(entry);
       entry = (struct TBEntry *)&DTM_pawn[i];
-      free_dtm_entry(entry);
+      if (entry->ready) free_dtm_entry(entry);
+      entry = (struct TBEntry *)&DTZ_pawn[i];
+      if (entry->ready) free_dtz_entry(entry);
     }
-    for (i = 0; i < DTZ_ENTRIES; i++)
-      if (DTZ_table[i].entry)
-        free_dtz_entry(DTZ_table[i].entry);
     LOCK_DESTROY(TB_mutex);
     path_string = NULL;
+    files_listed = 0;
+    probe_cache_clear();
+    clear_stats();
   }
 
   // if path is an empty string or equals "<empty>", we are done.
   const char *p = path;
   if (strlen(p) == 0 || !strcmp(p, "<empty>")) return;
 
+  TimePoint start = now();
+
   path_string = (char *)malloc(strlen(p) + 1);
   strcpy(path_string, p);
   num_paths = 0;
@@ -340,6 +820,7 @@ void TB_init(char *path)
 
   TBnum_piece = TBnum_pawn = 0;
   TB_MaxCardinality = TB_MaxCardinalityDTM = 0;
+  hot_bytes = 0;
 
   for (i = 0; i < (1 << TBHASHBITS); i++)
     for (j = 0; j < HSHMAX; j++) {
@@ -347,8 +828,7 @@ void TB_init(char *path)
       TB_hash[i][j].ptr = NULL;
     }
 
-  for (i = 0; i < DTZ_ENTRIES; i++)
-    DTZ_table[i].entry = NULL;
+  list_files();
 
   for (i = 1; i < 6; i++) {
     sprintf(str, "K%cvK", pchr[i]);
@@ -405,7 +885,35 @@ void TB_init(char *path)
           init_tb(str);
         }
 
-  printf("info string Found %d tablebases.\n", TBnum_piece + TBnum_pawn);
+  for (i = 1; i < 6; i++)
+    for (j = i; j < 6; j++)
+      for (k = j; k < 6; k++)
+        for (l = k; l < 6; l++)
+          for (m = l; m < 6; m++) {
+            sprintf(str, "K%c%c%c%c%cvK", pchr[i], pchr[j], pchr[k], pchr[l], pchr[m]);
+            init_tb(str);
+          }
+
+  for (i = 1; i < 6; i++)
+    for (j = i; j < 6; j++)
+      for (k = j; k < 6; k++)
+        for (l = k; l < 6; l++)
+          for (m = 1; m < 6; m++) {
+            sprintf(str, "K%c%c%c%cvK%c", pchr[i], pchr[j], pchr[k], pchr[l], pchr[m]);
+            init_tb(str);
+          }
+
+  for (i = 1; i < 6; i++)
+    for (j = i; j < 6; j++)
+      for (k = j; k < 6; k++)
+        for (l = 1; l < 6; l++)
+          for (m = l; m < 6; m++) {
+            sprintf(str, "K%c%c%cvK%c%c", pchr[i], pchr[j], pchr[k], pchr[l], pchr[m]);
+            init_tb(str);
+          }
+
+  printf("info string Found %d tablebases in %d ms.\n",
+         TBnum_piece + TBnum_pawn, (int)(now() - start));
   fflush(stdout);
 }
 
@@ -620,21 +1128,21 @@ static const int16_t KK_idx[10][64] = {
     -1, -1, -1, -1, -1, -1, -1,461 }
 };
 
-static int binomial[5][64];
-static int pawnidx[5][24];
-static int pfactor[5][4];
-static int pawnidx2[5][24];
-static int pfactor2[5][6];
+static int binomial[TBPIECES - 1][64];
+static int pawnidx[TBPIECES - 1][24];
+static int pfactor[TBPIECES - 1][4];
+static int pawnidx2[TBPIECES - 1][24];
+static int pfactor2[TBPIECES - 1][6];
 
 static void init_indices(void)
 {
   int i, j, k;
 
 // binomial[k-1][n] = Bin(n, k)
-  for (i = 0; i < 5; i++)
+  for (i = 0; i < TBPIECES - 1; i++)
     for (j = 0; j < 64; j++) {
-      int f = j;
-      int l = 1;
+      uint64_t f = j;
+      uint64_t l = 1;
       for (k = 1; k <= i; k++) {
         f *= (j - k);
         l *= (k + 1);
@@ -642,7 +1150,7 @@ static void init_indices(void)
       binomial[i][j] = f / l;
     }
 
-  for (i = 0; i < 5; i++) {
+  for (i = 0; i < TBPIECES - 1; i++) {
     int s = 0;
     for (j = 0; j < 6; j++) {
       pawnidx[i][j] = s;
@@ -669,7 +1177,7 @@ static void init_indices(void)
     pfactor[i][3] = s;
   }
 
-  for (i = 0; i < 5; i++) {
+  for (i = 0; i < TBPIECES - 1; i++) {
     int s = 0;
     for (j = 0; j < 4; j++) {
       pawnidx2[i][j] = s;
@@ -709,7 +1217,7 @@ static void init_indices(void)
   }
 }
 
-static uint64_t encode_piece(struct TBEntry_piece *ptr, uint8_t *norm, int *pos, int *factor)
+static uint64_t encode_piece(struct TBEntry_piece *ptr, uint8_t *norm, int *pos, uint64_t *factor)
 {
   uint64_t idx;
   int i, j, k, m, l, p;
@@ -799,7 +1307,7 @@ static int pawn_file(struct TBEntry_pawn *ptr, int *pos)
   return file_to_file[pos[0] & 0x07];
 }
 
-static uint64_t encode_pawn(struct TBEntry_pawn *ptr, uint8_t *norm, int *pos, int *factor)
+static uint64_t encode_pawn(struct TBEntry_pawn *ptr, uint8_t *norm, int *pos, uint64_t *factor)
 {
   uint64_t idx;
   int i, j, k, m, s, t;
@@ -869,7 +1377,7 @@ int pawn_rank(struct TBEntry_pawn2 *ptr, int *pos)
   return (pos[0] - 8) >> 3;
 }
 
-uint64_t encode_pawn2(struct TBEntry_pawn2 *ptr, uint8_t *norm, int *pos, int *factor)
+uint64_t encode_pawn2(struct TBEntry_pawn2 *ptr, uint8_t *norm, int *pos, uint64_t *factor)
 {
   uint64_t idx;
   int i, j, k, m, s, t;
@@ -928,9 +1436,10 @@ uint64_t encode_pawn2(struct TBEntry_pawn2 *ptr, uint8_t *norm, int *pos, int *f
 }
 
 // place k like pieces on n squares
-static int subfactor(int k, int n)
+static uint64_t subfactor(int k, int n)
 {
-  int i, f, l;
+  int i;
+  uint64_t f, l;
 
   f = n;
   l = 1;
@@ -942,7 +1451,7 @@ static int subfactor(int k, int n)
   return f / l;
 }
 
-static uint64_t calc_factors_piece(int *factor, int num, int order, uint8_t *norm, uint8_t enc_type)
+static uint64_t calc_factors_piece(uint64_t *factor, int num, int order, uint8_t *norm, uint8_t enc_type)
 {
   int i, k, n;
   uint64_t f;
@@ -966,7 +1475,7 @@ static uint64_t calc_factors_piece(int *factor, int num, int order, uint8_t *nor
   return f;
 }
 
-static uint64_t calc_factors_pawn(int *factor, int num, int order, int order2, uint8_t *norm, int file)
+static uint64_t calc_factors_pawn(uint64_t *factor, int num, int order, int order2, uint8_t *norm, int file)
 {
   int i = norm[0];
   if (order2 < 0x0f) i += norm[i];
@@ -991,7 +1500,7 @@ static uint64_t calc_factors_pawn(int *factor, int num, int order, int order2, u
   return f;
 }
 
-static uint64_t calc_factors_pawn2(int *factor, int num, int order, int order2, uint8_t *norm, int rank)
+static uint64_t calc_factors_pawn2(uint64_t *factor, int num, int order, int order2, uint8_t *norm, int rank)
 {
   int i, k, n;
   uint64_t f;
@@ -1167,6 +1676,9 @@ static struct PairsData *setup_pairs(uint8_t *data, uint64_t tb_size, uint64_t *
   if (data[0] & 0x80) {
     d = (struct PairsData *)malloc(sizeof(struct PairsData));
     d->idxbits = 0;
+    d->lookup = NULL;
+    atomic_init(&d->prefetched, UINT64_MAX);
+    d->tb_size = tb_size;
     d->const_val[0] = wdl ? data[1] : 0;
     d->const_val[1] = 0;
     *next = data + 2;
@@ -1182,13 +1694,21 @@ static struct PairsData *setup_pairs(uint8_t *data, uint64_t tb_size, uint64_t *
   int min_len = data[9];
   int h = max_len - min_len + 1;
   uint32_t num_syms = read_uint16_t(&data[10 + 2 * h]);
-  d = (struct PairsData *)malloc(sizeof(struct PairsData) + h * sizeof(base_t) + num_syms);
+
+  // The lookup table is only worth it if the codes have different lengths
+  // and some of them fit in LOOKUP_BITS bits.
+  int use_lookup = max_len > min_len && min_len <= LOOKUP_BITS;
+  size_t lookup_size = use_lookup ? sizeof(uint16_t) << LOOKUP_BITS : 0;
+  d = (struct PairsData *)malloc(sizeof(struct PairsData) + h * sizeof(base_t) + lookup_size + num_syms);
   d->blocksize = blocksize;
   d->idxbits = idxbits;
+  d->tb_size = tb_size;
   d->offset = (uint16_t *)&data[10];
-  d->symlen = (uint8_t *)d + sizeof(struct PairsData) + h * sizeof(base_t);
+  d->lookup = use_lookup ? (uint16_t *)((uint8_t *)d + sizeof(struct PairsData) + h * sizeof(base_t)) : NULL;
+  d->symlen = (uint8_t *)d + sizeof(struct PairsData) + h * sizeof(base_t) + lookup_size;
   d->sympat = &data[12 + 2 * h];
   d->min_len = min_len;
+  atomic_init(&d->prefetched, UINT64_MAX);
   *next = &data[12 + 2 * h + 3 * num_syms + (num_syms & 1)];
 
   uint64_t num_indices = (tb_size + (1ULL << idxbits) - 1) >> idxbits;
@@ -1210,6 +1730,24 @@ static struct PairsData *setup_pairs(uint8_t *data, uint64_t tb_size, uint64_t *
 
   d->offset -= d->min_len;
 
+  // A code of at most LOOKUP_BITS bits is determined by the first
+  // LOOKUP_BITS bits of the input, so these can be looked up. An entry
+  // holds the code length in its top 4 bits and the symbol in the other
+  // 12. Longer codes get the length to continue the search from.
+  if (use_lookup) {
+    base_t *base = d->base - min_len;
+    for (int p = 0; p < (1 << LOOKUP_BITS); p++) {
+      uint64_t code = (uint64_t)p << (64 - LOOKUP_BITS);
+      int l = min_len;
+      while (l <= LOOKUP_BITS && code < base[l]) l++;
+      if (l > LOOKUP_BITS)
+        d->lookup[p] = l;
+      else
+        d->lookup[p] = (l << 12) | (read_uint16_t((uint8_t *)(d->offset + l))
+                                    + ((code - base[l]) >> (64 - l)));
+    }
+  }
+
   return d;
 }
 
@@ -1223,7 +1761,8 @@ static int init_table(struct TBEntry *entry, char *str, int dtm)
 
   // first mmap the table into memory
 
-  entry->data = map_file(str, !dtm ? WDLSUFFIX : DTMSUFFIX, &entry->mapping);
+  entry->data = map_file(str, !dtm ? WDLSUFFIX : DTMSUFFIX, &entry->mapping,
+                         &entry->size);
   if (!entry->data) {
     if (!dtm)
       fprintf(stderr, "Could not find %s" WDLSUFFIX, str);
@@ -1444,9 +1983,16 @@ static int init_table_dtz(struct TBEntry *entry)
 
     ptr->map = data;
     if (ptr->flags & 2) {
-      for (int i = 0; i < 4; i++) {
-        ptr->map_idx[i] = data + 1 - ptr->map;
-        data += 1 + data[0];
+      if (ptr->flags & 16) {
+        for (int i = 0; i < 4; i++) {
+          ptr->map_idx[i] = (uint16_t *)data + 1 - (uint16_t *)ptr->map;
+          data += 2 + 2 * read_uint16_t(data);
+        }
+      } else {
+        for (int i = 0; i < 4; i++) {
+          ptr->map_idx[i] = data + 1 - ptr->map;
+          data += 1 + data[0];
+        }
       }
       data += (uintptr_t)data & 0x01;
     }
@@ -1476,7 +2022,14 @@ static int init_table_dtz(struct TBEntry *entry)
 
     ptr->map = data;
     for (f = 0; f < files; f++) {
-      if (ptr->flags[f] & 2) {
+      if (ptr->flags[f] & 16) {
+        // Maps of 16-bit values are word aligned, also in mixed tables.
+        data += (uintptr_t)data & 0x01;
+        for (int i = 0; i < 4; i++) {
+          ptr->map_idx[f][i] = (uint16_t *)data + 1 - (uint16_t *)ptr->map;
+          data += 2 + 2 * read_uint16_t(data);
+        }
+      } else if (ptr->flags[f] & 2) {
         for (int i = 0; i < 4; i++) {
           ptr->map_idx[f][i] = data + 1 - ptr->map;
           data += 1 + data[0];
@@ -1514,15 +2067,14 @@ INLINE int is_little_endian() {
   return x.c[0] == 1;
 }
 
-static uint8_t *decompress_pairs(struct PairsData *d, uint64_t idx)
+// find_block() returns the number of the block that holds index idx of
+// d and stores the position of idx within the block in *litidx.
+static uint32_t find_block(struct PairsData *d, uint64_t idx, int *litidx)
 {
   const int LittleEndian = is_little_endian();
 
-  if (!d->idxbits)
-    return d->const_val;
-
-  uint32_t mainidx = idx >> d->idxbits;
-  int litidx = (idx & ((1ULL << d->idxbits) - 1)) - (1ULL << (d->idxbits - 1));
+  uint64_t mainidx = idx >> d->idxbits;
+  int lit = (idx & ((1ULL << d->idxbits) - 1)) - (1ULL << (d->idxbits - 1));
   uint32_t block;
   memcpy(&block, d->indextable + 6 * mainidx, sizeof(uint32_t));
   if (!LittleEndian)
@@ -1531,23 +2083,66 @@ static uint8_t *decompress_pairs(struct PairsData *d, uint64_t idx)
   uint16_t idxOffset = *(uint16_t *)(d->indextable + 6 * mainidx + 4);
   if (!LittleEndian)
     idxOffset = (idxOffset << 8) | (idxOffset >> 8);
-  litidx += idxOffset;
+  lit += idxOffset;
 
-  if (litidx < 0) {
+  if (lit < 0) {
     do {
-      litidx += d->sizetable[--block] + 1;
-    } while (litidx < 0);
+      lit += d->sizetable[--block] + 1;
+    } while (lit < 0);
   } else {
-    while (litidx > d->sizetable[block])
-      litidx -= d->sizetable[block++] + 1;
+    while (lit > d->sizetable[block])
+      lit -= d->sizetable[block++] + 1;
   }
 
-  uint32_t *ptr = (uint32_t *)(d->data + (block << d->blocksize));
+  *litidx = lit;
+  return block;
+}
+
+// prefetch_pairs() asks the OS to start reading the block that holds
+// index idx of d. Finding the block may itself have to wait for the
+// index and size tables, but those are much smaller and mostly resident.
+// The last block advised is remembered, tagged with the release count so
+// that a block dropped by release_table() is advised again, and is not
+// advised twice in a row.
+static void prefetch_pairs(struct PairsData *d, uint64_t idx)
+{
+  if (!d->idxbits)
+    return;
+
+  int litidx;
+  uint32_t block = find_block(d, idx, &litidx);
+  uint64_t tag =  (uint64_t)atomic_load_explicit(&TB_releases, memory_order_relaxed) << 32
+                | block;
+  if (atomic_load_explicit(&d->prefetched, memory_order_relaxed) == tag)
+    return;
+  atomic_store_explicit(&d->prefetched, tag, memory_order_relaxed);
+
+  uint8_t *ptr = d->data + ((uint64_t)block << d->blocksize);
+#ifndef _WIN32
+  uintptr_t start = (uintptr_t)ptr & ~(uintptr_t)4095;
+  madvise((void *)start, (uintptr_t)ptr + (1 << d->blocksize) - start,
+          MADV_WILLNEED);
+#else
+  (void)ptr;
+#endif
+}
+
+static uint8_t *decompress_pairs(struct PairsData *d, uint64_t idx)
+{
+  const int LittleEndian = is_little_endian();
+
+  if (!d->idxbits)
+    return d->const_val;
+
+  int litidx;
+  uint32_t block = find_block(d, idx, &litidx);
+  uint32_t *ptr = (uint32_t *)(d->data + ((uint64_t)block << d->blocksize));
 
   int m = d->min_len;
   uint16_t *offset = d->offset;
   base_t *base = d->base - m;
   uint8_t *symlen = d->symlen;
+  uint16_t *lookup = d->lookup;
   int sym, bitcnt;
 
   uint64_t code = *(uint64_t *)ptr;
@@ -1557,12 +2152,18 @@ static uint8_t *decompress_pairs(struct PairsData *d, uint64_t idx)
   ptr += 2;
   bitcnt = 0; // number of "empty bits" in code
   for (;;) {
-    int l = m;
-    while (code < base[l]) l++;
-    sym = offset[l];
-    if (!LittleEndian)
-      sym = ((sym & 0xff) << 8) | (sym >> 8);
-    sym += (code - base[l]) >> (64 - l);
+    int l, e = lookup ? lookup[code >> (64 - LOOKUP_BITS)] : m;
+    if (e >> 12) {
+      l = e >> 12;
+      sym = e & 0xfff;
+    } else {
+      l = e;
+      while (code < base[l]) l++;
+      sym = offset[l];
+      if (!LittleEndian)
+        sym = ((sym & 0xff) << 8) | (sym >> 8);
+      sym += (code - base[l]) >> (64 - l);
+    }
     if (litidx < (int)symlen[sym] + 1) break;
     litidx -= (int)symlen[sym] + 1;
     code <<= l;
@@ -1591,43 +2192,73 @@ static uint8_t *decompress_pairs(struct PairsData *d, uint64_t idx)
   return &sympat[3 * sym];
 }
 
-void load_dtz_table(char *str, uint64_t key1, uint64_t key2)
+// block_resident() returns whether the block that holds index idx of d
+// is in the page cache.
+static int block_resident(struct PairsData *d, uint64_t idx)
 {
-  int i;
-  struct TBEntry *ptr, *ptr3;
-  struct TBHashEntry *ptr2;
-
-  DTZ_table[0].key1 = key1;
-  DTZ_table[0].key2 = key2;
-  DTZ_table[0].entry = NULL;
-
-  // find corresponding WDL entry
-  ptr2 = TB_hash[key1 >> (64 - TBHASHBITS)];
-  for (i = 0; i < HSHMAX; i++)
-    if (ptr2[i].key == key1) break;
-  if (i == HSHMAX) return;
-  ptr = ptr2[i].ptr;
-
-  ptr3 = malloc(ptr->has_pawns ? sizeof(struct DTZEntry_pawn)
-                               : sizeof(struct DTZEntry_piece));
-
-  ptr3->data = map_file(str, DTZSUFFIX, &ptr3->mapping);
-  ptr3->key = ptr->key;
-  ptr3->num = ptr->num;
-  ptr3->symmetric = ptr->symmetric;
-  ptr3->has_pawns = ptr->has_pawns;
-  if (ptr3->has_pawns) {
-    struct DTZEntry_pawn *entry = (struct DTZEntry_pawn *)ptr3;
-    entry->pawns[0] = ((struct TBEntry_pawn *)ptr)->pawns[0];
-    entry->pawns[1] = ((struct TBEntry_pawn *)ptr)->pawns[1];
-  } else {
-    struct DTZEntry_piece *entry = (struct DTZEntry_piece *)ptr3;
-    entry->enc_type = ((struct TBEntry_piece *)ptr)->enc_type;
+#ifndef _WIN32
+  if (!d->idxbits)
+    return 1;
+
+  int litidx;
+  uint8_t *ptr = d->data + ((uint64_t)find_block(d, idx, &litidx) << d->blocksize);
+  uintptr_t page = sysconf(_SC_PAGESIZE);
+  uintptr_t start = (uintptr_t)ptr & ~(page - 1);
+  uintptr_t end = (uintptr_t)ptr + (1 << d->blocksize);
+  unsigned char vec[64];
+  size_t n = min((end - start + page - 1) / page, sizeof(vec));
+  if (mincore((void *)start, n * page, vec))
+    return 1;
+  for (size_t i = 0; i < n; i++)
+    if (!(vec[i] & 1))
+      return 0;
+#else
+  (void)d; (void)idx;
+#endif
+  return 1;
+}
+
+// decompress_stats() is decompress_pairs() for a table of the given type,
+// counted and timed.
+static uint8_t *decompress_stats(struct TBEntry *entry, int type,
+                                 struct PairsData *d, uint64_t idx)
+{
+  struct TBStats *s = &TB_stats[tb_index(entry, type)];
+
+  if (!block_resident(d, idx))
+    atomic_fetch_add_explicit(&s->cold, 1, memory_order_relaxed);
+
+  uint64_t t = tb_nanos();
+  uint8_t *w = decompress_pairs(d, idx);
+  t = tb_nanos() - t;
+
+  atomic_fetch_add_explicit(&s->reads, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&s->nanos, t, memory_order_relaxed);
+  int b = 0;
+  while (b < TB_HIST_BUCKETS - 1 && t >= (128ULL << b))
+    b++;
+  atomic_fetch_add_explicit(&DecodeHist[type][b], 1, memory_order_relaxed);
+
+  return w;
+}
+
+INLINE uint8_t *decompress_entry(struct TBEntry *entry, int type,
+                                 struct PairsData *d, uint64_t idx)
+{
+  if (TB_StatsOn)
+    return decompress_stats(entry, type, d, idx);
+  return decompress_pairs(d, idx);
+}
+
+static int init_dtz_table(struct TBEntry *entry, char *str)
+{
+  entry->data = map_file(str, DTZSUFFIX, &entry->mapping, &entry->size);
+  if (!init_table_dtz(entry)) {
+    unmap_file(entry->data, entry->mapping);
+    entry->data = NULL;
+    return 0;
   }
-  if (!init_table_dtz(ptr3))
-    free(ptr3);
-  else
-    DTZ_table[0].entry = ptr3;
+  return 1;
 }
 
 static void free_wdl_entry(struct TBEntry *entry)
@@ -1677,7 +2308,6 @@ static void free_dtz_entry(struct TBEntry *entry)
     for (int f = 0; f < 4; f++)
       free(ptr->file[f].precomp);
   }
-  free(entry);
 }
 
 static int wdl_to_map[5] = { 1, 3, 0, 2, 0 };
@@ -44,13 +44,13 @@
 #define WDLSUFFIX ".rtbw"
 #define DTZSUFFIX ".rtbz"
 #define DTMSUFFIX ".rtbm"
-#define TBPIECES 6
+#define TBPIECES 7
 
 const uint32_t WDL_MAGIC = 0x5d23e871;
 const uint32_t DTZ_MAGIC = 0xa50c66d7;
 const uint32_t DTM_MAGIC = 0x88ac504b;
 
-#define TBHASHBITS 10
+#define TBHASHBITS 12
 
 struct TBHashEntry;
 
@@ -63,10 +63,13 @@ struct PairsData {
   uint16_t *offset;
   uint8_t *symlen;
   uint8_t *sympat;
+  uint16_t *lookup;
+  uint64_t tb_size;
   uint32_t blocksize;
   uint32_t idxbits;
   uint8_t min_len;
   uint8_t const_val[2];
+  atomic_uint_fast64_t prefetched; // Last block passed to madvise()
   base_t base[]; // must be base[1] in C++
 };
 
@@ -74,7 +77,10 @@ struct TBEntry {
   uint8_t *data;
   Key key;
   uint64_t mapping;
+  uint64_t size;
+  atomic_uint lru;
   atomic_uchar ready;
+  atomic_uchar hot;
   uint8_t num;
   uint8_t symmetric;
   uint8_t has_pawns;
@@ -89,14 +95,17 @@ struct TBEntry_piece {
   uint8_t *data;
   Key key;
   uint64_t mapping;
+  uint64_t size;
+  atomic_uint lru;
   atomic_uchar ready;
+  atomic_uchar hot;
   uint8_t num;
   uint8_t symmetric;
   uint8_t has_pawns;
   uint8_t loss_only;
   uint8_t enc_type;
   struct PairsData *precomp[2];
-  int factor[2][TBPIECES];
+  uint64_t factor[2][TBPIECES];
   uint8_t pieces[2][TBPIECES];
   uint8_t norm[2][TBPIECES];
 };
@@ -105,7 +114,10 @@ struct TBEntry_pawn {
   uint8_t *data;
   Key key;
   uint64_t mapping;
+  uint64_t size;
+  atomic_uint lru;
   atomic_uchar ready;
+  atomic_uchar hot;
   uint8_t num;
   uint8_t symmetric;
   uint8_t has_pawns;
@@ -113,7 +125,7 @@ struct TBEntry_pawn {
   uint8_t pawns[2];
   struct {
     struct PairsData *precomp[2];
-    int factor[2][TBPIECES];
+    uint64_t factor[2][TBPIECES];
     uint8_t pieces[2][TBPIECES];
     uint8_t norm[2][TBPIECES];
   } file[4];
@@ -123,7 +135,10 @@ struct TBEntry_pawn2 {
   uint8_t *data;
   Key key;
   uint64_t mapping;
+  uint64_t size;
+  atomic_uint lru;
   atomic_uchar ready;
+  atomic_uchar hot;
   uint8_t num;
   uint8_t symmetric;
   uint8_t has_pawns;
@@ -131,7 +146,7 @@ struct TBEntry_pawn2 {
   uint8_t pawns[2];
   struct {
     struct PairsData *precomp[2];
-    int factor[2][TBPIECES];
+    uint64_t factor[2][TBPIECES];
     uint8_t pieces[2][TBPIECES];
     uint8_t norm[2][TBPIECES];
   } rank[6];
@@ -141,14 +156,17 @@ struct DTZEntry_piece {
   uint8_t *data;
   Key key;
   uint64_t mapping;
+  uint64_t size;
+  atomic_uint lru;
   atomic_uchar ready;
+  atomic_uchar hot;
   uint8_t num;
   uint8_t symmetric;
   uint8_t has_pawns;
   uint8_t loss_only;
   uint8_t enc_type;
   struct PairsData *precomp;
-  int factor[TBPIECES];
+  uint64_t factor[TBPIECES];
   uint8_t pieces[TBPIECES];
   uint8_t norm[TBPIECES];
   uint8_t flags; // accurate, mapped, side
@@ -160,7 +178,10 @@ struct DTZEntry_pawn {
   uint8_t *data;
   Key key;
   uint64_t mapping;
+  uint64_t size;
+  atomic_uint lru;
   atomic_uchar ready;
+  atomic_uchar hot;
   uint8_t num;
   uint8_t symmetric;
   uint8_t has_pawns;
@@ -168,7 +189,7 @@ struct DTZEntry_pawn {
   uint8_t pawns[2];
   struct {
     struct PairsData *precomp;
-    int factor[TBPIECES];
+    uint64_t factor[TBPIECES];
     uint8_t pieces[TBPIECES];
     uint8_t norm[TBPIECES];
   } file[4];
@@ -181,14 +202,17 @@ struct DTMEntry_piece {
   uint8_t *data;
   Key key;
   uint64_t mapping;
+  uint64_t size;
+  atomic_uint lru;
   atomic_uchar ready;
+  atomic_uchar hot;
   uint8_t num;
   uint8_t symmetric;
   uint8_t has_pawns;
   uint8_t loss_only;
   uint8_t enc_type;
   struct PairsData *precomp[2];
-  int factor[2][TBPIECES];
+  uint64_t factor[2][TBPIECES];
   uint8_t pieces[2][TBPIECES];
   uint8_t norm[2][TBPIECES];
   uint16_t map_idx[2][2];
@@ -199,7 +223,10 @@ struct DTMEntry_pawn {
   uint8_t *data;
   Key key;
   uint64_t mapping;
+  uint64_t size;
+  atomic_uint lru;
   atomic_uchar ready;
+  atomic_uchar hot;
   uint8_t num;
   uint8_t symmetric;
   uint8_t has_pawns;
@@ -207,7 +234,7 @@ struct DTMEntry_pawn {
   uint8_t pawns[2];
   struct {
     struct PairsData *precomp[2];
-    int factor[2][TBPIECES];
+    uint64_t factor[2][TBPIECES];
     uint8_t pieces[2][TBPIECES];
     uint8_t norm[2][TBPIECES];
   } rank[6];
@@ -219,12 +246,7 @@ struct TBHashEntry {
   Key key;
   struct TBEntry *ptr;
   struct TBEntry *dtm_ptr;
-};
-
-struct DTZTableEntry {
-  Key key1;
-  Key key2;
-  struct TBEntry *entry;
+  struct TBEntry *dtz_ptr;
 };
 
 #endif
@@ -7,10 +7,15 @@
   this code to other chess engines.
 */
 
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <stdio.h>
+
 #include "position.h"
 #include "movegen.h"
 #include "bitboard.h"
 #include "search.h"
+#include "thread.h"
 #include "uci.h"
 
 #include "tbprobe.h"
@@ -21,9 +26,15 @@
 extern Key mat_key[16];
 
 int TB_MaxCardinality = 0, TB_MaxCardinalityDTM = 0;
+
+// Set to abandon the root probes below between two moves.
+atomic_bool TB_RootProbeStop;
 extern int TB_CardinalityDTM;
 
-// Given a position with 6 or fewer pieces, produce a text string
+// Table types, numbered as in tb_entry().
+enum { PC_WDL, PC_DTM, PC_DTZ };
+
+// Given a position with 7 or fewer pieces, produce a text string
 // of the form KQPvKRP, where "KQP" represents the white pieces if
 // mirror == 0 and the black pieces if mirror == 1.
 static void prt_str(Pos *pos, char *str, int mirror)
@@ -41,22 +52,6 @@ static void prt_str(Pos *pos, char *str, int mirror)
   *str++ = 0;
 }
 
-// Given a position, produce a 64-bit material signature key.
-// If the engine supports such a key, it should equal the engine's key.
-static Key calc_key(Pos *pos, int mirror)
-{
-  Key key = 0;
-
-  int color = !mirror ? WHITE : BLACK;
-  for (int pt = PAWN; pt <= KING; pt++)
-    key += mat_key[pt] * popcount(pieces_cp(color, pt));
-  color ^= 1;
-  for (int pt = PAWN; pt <= KING; pt++)
-    key += mat_key[pt + 8] * popcount(pieces_cp(color, pt));
-
-  return key;
-}
-
 // Produce a 64-bit material key corresponding to the material combination
 // defined by pcs[16], where pcs[1], ..., pcs[6] is the number of white
 // pawns, ..., kings and pcs[9], ..., pcs[14] is the number of black
@@ -87,50 +82,15 @@ static Key calc_key_from_pieces(uint8_t *piece, int num, int mirror)
   return key;
 }
 
-// probe_wdl_table and probe_dtz_table require similar adaptations.
-static int probe_wdl_table(Pos *pos, int *success)
+// wdl_pairs() returns the part of the WDL table ptr that holds the
+// position and stores the index of the position in *idx.
+// wdl_pairs and read_dtz_table require similar adaptations.
+static struct PairsData *wdl_pairs(Pos *pos, struct TBEntry *ptr, Key key,
+                                   uint64_t *idx)
 {
-  struct TBEntry *ptr;
-  struct TBHashEntry *ptr2;
-  uint64_t idx;
   int i;
-  uint8_t res;
   int p[TBPIECES];
 
-  // Obtain the position's material signature key.
-  Key key = pos_material_key();
-
-  // Test for KvK.
-  if (key == 2ULL)
-    return 0;
-
-  ptr2 = TB_hash[key >> (64 - TBHASHBITS)];
-  for (i = 0; i < HSHMAX; i++)
-    if (ptr2[i].key == key) break;
-  if (i == HSHMAX) {
-    *success = 0;
-    return 0;
-  }
-
-  ptr = ptr2[i].ptr;
-  // With the help of C11 atomics, we implement double-checked locking
-  // correctly.
-  if (!atomic_load_explicit(&ptr->ready, memory_order_acquire)) {
-    LOCK(TB_mutex);
-    if (!atomic_load_explicit(&ptr->ready, memory_order_relaxed)) {
-      char str[16];
-      prt_str(pos, str, ptr->key != key);
-      if (!init_table(ptr, str, 0)) {
-        ptr2[i].key = 0ULL;
-        *success = 0;
-        UNLOCK(TB_mutex);
-        return 0;
-      }
-      atomic_store_explicit(&ptr->ready, 1, memory_order_release);
-    }
-    UNLOCK(TB_mutex);
-  }
-
   int bside, mirror, cmirror;
   if (!ptr->symmetric) {
     if (key != ptr->key) {
@@ -159,8 +119,8 @@ static int probe_wdl_table(Pos *pos, int *success)
         p[i++] = pop_lsb(&bb);
       } while (bb);
     }
-    idx = encode_piece(entry, entry->norm[bside], p, entry->factor[bside]);
-    res = *decompress_pairs(entry->precomp[bside], idx);
+    *idx = encode_piece(entry, entry->norm[bside], p, entry->factor[bside]);
+    return entry->precomp[bside];
   } else {
     struct TBEntry_pawn *entry = (struct TBEntry_pawn *)ptr;
     int k = entry->file[0].pieces[0][0] ^ cmirror;
@@ -178,14 +138,58 @@ static int probe_wdl_table(Pos *pos, int *success)
         p[i++] = pop_lsb(&bb) ^ mirror;
       } while (bb);
     }
-    idx = encode_pawn(entry, entry->file[f].norm[bside], p, entry->file[f].factor[bside]);
-    res = *decompress_pairs(entry->file[f].precomp[bside], idx);
+    *idx = encode_pawn(entry, entry->file[f].norm[bside], p, entry->file[f].factor[bside]);
+    return entry->file[f].precomp[bside];
   }
+}
 
-  return res - 2;
+static int read_wdl_table(Pos *pos, int *success)
+{
+  struct TBEntry *ptr;
+  struct TBHashEntry *ptr2;
+  uint64_t idx;
+  int i;
+
+  // Obtain the position's material signature key.
+  Key key = pos_material_key();
+
+  // Test for KvK.
+  if (key == 2ULL)
+    return 0;
+
+  ptr2 = TB_hash[key >> (64 - TBHASHBITS)];
+  for (i = 0; i < HSHMAX; i++)
+    if (ptr2[i].key == key) break;
+  if (i == HSHMAX) {
+    *success = 0;
+    return 0;
+  }
+
+  ptr = ptr2[i].ptr;
+  // With the help of C11 atomics, we implement double-checked locking
+  // correctly.
+  if (!atomic_load_explicit(&ptr->ready, memory_order_acquire)) {
+    LOCK(TB_mutex);
+    if (!atomic_load_explicit(&ptr->ready, memory_order_relaxed)) {
+      char str[16];
+      prt_str(pos, str, ptr->key != key);
+      if (!init_table(ptr, str, 0)) {
+        ptr2[i].key = 0ULL;
+        *success = 0;
+        UNLOCK(TB_mutex);
+        return 0;
+      }
+      atomic_store_explicit(&ptr->ready, 1, memory_order_release);
+    }
+    UNLOCK(TB_mutex);
+  }
+  touch_table(ptr);
+
+  struct PairsData *d = wdl_pairs(pos, ptr, key, &idx);
+  return *decompress_entry(ptr, PC_WDL, d, idx) - 2;
 }
 
-static int probe_dtm_table(Pos *pos, int won, int *success)
+static int read_dtm_table(Pos *pos, int won, int *success)
 {
   struct TBEntry *ptr;
   struct TBHashEntry *ptr2;
@@ -233,6 +237,7 @@ static int probe_dtm_table(Pos *pos, int won, int *success)
     }
     UNLOCK(TB_mutex);
   }
+  touch_table(ptr);
 
   int bside, mirror, cmirror;
   if (!ptr->symmetric) {
@@ -263,7 +268,7 @@ static int probe_dtm_table(Pos *pos, int won, int *success)
       } while (bb);
     }
     idx = encode_piece((struct TBEntry_piece *)entry, entry->norm[bside], p, entry->factor[bside]);
-    uint8_t *w = decompress_pairs(entry->precomp[bside], idx);
+    uint8_t *w = decompress_entry(ptr, PC_DTM, entry->precomp[bside], idx);
     res = ((w[1] & 0x0f) << 8) | w[0];
     if (!entry->loss_only)
       res = entry->map[entry->map_idx[bside][won] + res];
@@ -285,7 +290,7 @@ static int probe_dtm_table(Pos *pos, int won, int *success)
       } while (bb);
     }
     idx = encode_pawn2((struct TBEntry_pawn2 *)entry, entry->rank[r].norm[bside], p, entry->rank[r].factor[bside]);
-    uint8_t *w = decompress_pairs(entry->rank[r].precomp[bside], idx);
+    uint8_t *w = decompress_entry(ptr, PC_DTM, entry->rank[r].precomp[bside], idx);
     res = ((w[1] & 0x0f) << 8) | w[0];
     if (!entry->loss_only)
       res = entry->map[entry->map_idx[r][bside][won] + res];
@@ -294,9 +299,7 @@ static int probe_dtm_table(Pos *pos, int won, int *success)
   return res;
 }
 
-// The value of wdl MUST correspond to the WDL value of the position without
-// en passant rights.
-static int probe_dtz_table(Pos *pos, int wdl, int *success)
+static int read_dtz_table(Pos *pos, int wdl, int *success)
 {
   struct TBEntry *ptr;
   uint64_t idx;
@@ -307,40 +310,40 @@ static int probe_dtz_table(Pos *pos, int wdl, int *success)
   // Obtain the position's material signature key.
   Key key = pos_material_key();
 
-  if (DTZ_table[0].key1 != key && DTZ_table[0].key2 != key) {
-    for (i = 1; i < DTZ_ENTRIES; i++)
-      if (DTZ_table[i].key1 == key || DTZ_table[i].key2 == key) break;
-    if (i < DTZ_ENTRIES) {
-      struct DTZTableEntry table_entry = DTZ_table[i];
-      for (; i > 0; i--)
-        DTZ_table[i] = DTZ_table[i - 1];
-      DTZ_table[0] = table_entry;
-    } else {
-      struct TBHashEntry *ptr2 = TB_hash[key >> (64 - TBHASHBITS)];
-      for (i = 0; i < HSHMAX; i++)
-        if (ptr2[i].key == key) break;
-      if (i == HSHMAX) {
-        *success = 0;
-        return 0;
-      }
-      ptr = ptr2[i].ptr;
-      char str[16];
-      int mirror = (ptr->key != key);
-      prt_str(pos, str, mirror);
-      if (DTZ_table[DTZ_ENTRIES - 1].entry)
-        free_dtz_entry(DTZ_table[DTZ_ENTRIES-1].entry);
-      for (i = DTZ_ENTRIES - 1; i > 0; i--)
-        DTZ_table[i] = DTZ_table[i - 1];
-      load_dtz_table(str, calc_key(pos, mirror), calc_key(pos, !mirror));
-    }
+  struct TBHashEntry *ptr2 = TB_hash[key >> (64 - TBHASHBITS)];
+  for (i = 0; i < HSHMAX; i++)
+    if (ptr2[i].key == key) break;
+  if (i == HSHMAX) {
+    *success = 0;
+    return 0;
   }
 
-  ptr = DTZ_table[0].entry;
+  ptr = ptr2[i].dtz_ptr;
   if (!ptr) {
     *success = 0;
     return 0;
   }
 
+  // DTZ tables are loaded on first use with the same double-checked
+  // locking as the WDL tables and stay mapped until TB_init() is called
+  // again, so they can be probed from any thread.
+  if (!atomic_load_explicit(&ptr->ready, memory_order_acquire)) {
+    LOCK(TB_mutex);
+    if (!atomic_load_explicit(&ptr->ready, memory_order_relaxed)) {
+      char str[16];
+      prt_str(pos, str, ptr->key != key);
+      if (!init_dtz_table(ptr, str)) {
+        ptr2[i].dtz_ptr = NULL;
+        *success = 0;
+        UNLOCK(TB_mutex);
+        return 0;
+      }
+      atomic_store_explicit(&ptr->ready, 1, memory_order_release);
+    }
+    UNLOCK(TB_mutex);
+  }
+  touch_table(ptr);
+
   int bside, mirror, cmirror;
   if (!ptr->symmetric) {
     if (key != ptr->key) {
@@ -371,10 +374,13 @@ static int probe_dtz_table(Pos *pos, int wdl, int *success)
       } while (bb);
     }
     idx = encode_piece((struct TBEntry_piece *)entry, entry->norm, p, entry->factor);
-    res = *decompress_pairs(entry->precomp, idx);
+    uint8_t *w = decompress_entry(ptr, PC_DTZ, entry->precomp, idx);
+    res = ((w[1] & 0x0f) << 8) | w[0];
 
-    if (entry->flags & 2)
-      res = entry->map[entry->map_idx[wdl_to_map[wdl + 2]] + res];
+    if (entry->flags & 2) {
+      int m = entry->map_idx[wdl_to_map[wdl + 2]] + res;
+      res = entry->flags & 16 ? ((uint16_t *)entry->map)[m] : entry->map[m];
+    }
 
     if (!(entry->flags & pa_flags[wdl + 2]) || (wdl & 1))
       res *= 2;
@@ -400,10 +406,13 @@ static int probe_dtz_table(Pos *pos, int wdl, int *success)
       } while (bb);
     }
     idx = encode_pawn((struct TBEntry_pawn *)entry, entry->file[f].norm, p, entry->file[f].factor);
-    res = *decompress_pairs(entry->file[f].precomp, idx);
+    uint8_t *w = decompress_entry(ptr, PC_DTZ, entry->file[f].precomp, idx);
+    res = ((w[1] & 0x0f) << 8) | w[0];
 
-    if (entry->flags[f] & 2)
-      res = entry->map[entry->map_idx[f][wdl_to_map[wdl + 2]] + res];
+    if (entry->flags[f] & 2) {
+      int m = entry->map_idx[f][wdl_to_map[wdl + 2]] + res;
+      res = entry->flags[f] & 16 ? ((uint16_t *)entry->map)[m] : entry->map[m];
+    }
 
     if (!(entry->flags[f] & pa_flags[wdl + 2]) || (wdl & 1))
       res *= 2;
@@ -412,6 +421,478 @@ static int probe_dtz_table(Pos *pos, int wdl, int *success)
   return res;
 }
 
+// The probe cache keeps the results of recent table lookups, so that
+// positions probed again, by the same or another thread, do not need to be
+// decompressed again. It is lock-free in the same way as the transposition
+// table of Crafty: an entry stores key ^ data next to data, so that a torn
+// entry written by two threads at the same time does not verify. Results
+// of DTM and DTZ lookups also depend on their extra argument, which is
+// hashed into the key.
+
+#define PROBE_CACHE_BITS 16
+
+typedef struct {
+  atomic_uint_fast64_t check;
+  atomic_uint_fast64_t data;
+} ProbeCacheEntry;
+
+static ProbeCacheEntry ProbeCache[1 << PROBE_CACHE_BITS];
+
+static void probe_cache_clear(void)
+{
+  for (int i = 0; i < (1 << PROBE_CACHE_BITS); i++) {
+    atomic_store_explicit(&ProbeCache[i].check, 0, memory_order_relaxed);
+    atomic_store_explicit(&ProbeCache[i].data, 0, memory_order_relaxed);
+  }
+}
+
+INLINE Key probe_cache_key(Pos *pos, int type, int arg)
+{
+  return pos_key() ^ ((uint64_t)(4 * type + arg + 3) * 0x9e3779b97f4a7c15ULL);
+}
+
+// count_probe() counts a probe of the table of the position for
+// SyzygyStats.
+static void count_probe(Pos *pos, int type, int hit)
+{
+  Key key = pos_material_key();
+  struct TBHashEntry *ptr2 = TB_hash[key >> (64 - TBHASHBITS)];
+  int i = 0;
+  while (i < HSHMAX && ptr2[i].key != key) i++;
+  if (i == HSHMAX)
+    return;
+
+  struct TBEntry *ptr =  type == PC_WDL ? ptr2[i].ptr
+                       : type == PC_DTM ? ptr2[i].dtm_ptr : ptr2[i].dtz_ptr;
+  if (!ptr)
+    return;
+
+  struct TBStats *s = &TB_stats[tb_index(ptr, type)];
+  atomic_fetch_add_explicit(&s->probes, 1, memory_order_relaxed);
+  if (hit)
+    atomic_fetch_add_explicit(&s->hits, 1, memory_order_relaxed);
+}
+
+// The data word holds the result in the low 32 bits and the value of
+// *success + 1 above it. Bit 63 marks the entry as used.
+static int probe_cache_get(Pos *pos, Key key, int type, int *v, int *success)
+{
+  ProbeCacheEntry *e = &ProbeCache[key & ((1 << PROBE_CACHE_BITS) - 1)];
+  uint64_t data = atomic_load_explicit(&e->data, memory_order_relaxed);
+  uint64_t check = atomic_load_explicit(&e->check, memory_order_relaxed);
+  int hit = data && (check ^ data) == key;
+
+  // Probes are only counted with SyzygyStats set, so that the threads do
+  // not contend for the counters otherwise.
+  if (TB_StatsOn)
+    count_probe(pos, type, hit);
+  if (!hit)
+    return 0;
+
+  *v = (int32_t)(uint32_t)data;
+  if ((int)((data >> 32) & 3) != 2)
+    *success = (int)((data >> 32) & 3) - 1;
+  return 1;
+}
+
+static void probe_cache_put(Key key, int v, int success)
+{
+  ProbeCacheEntry *e = &ProbeCache[key & ((1 << PROBE_CACHE_BITS) - 1)];
+  uint64_t data = (1ULL << 63) | ((uint64_t)(success + 1) << 32) | (uint32_t)v;
+
+  atomic_store_explicit(&e->data, data, memory_order_relaxed);
+  atomic_store_explicit(&e->check, key ^ data, memory_order_relaxed);
+}
+
+// probe_wdl_table(), probe_dtm_table() and probe_dtz_table() look up the
+// position in the probe cache before reading the table. They only ever
+// change *success if the lookup fails or, for DTZ, if the table stores
+// the other side to move. Failed lookups are not cached.
+
+static int probe_wdl_table(Pos *pos, int *success)
+{
+  Key key = probe_cache_key(pos, PC_WDL, 0);
+  int v, s = 1;
+
+  if (probe_cache_get(pos, key, PC_WDL, &v, success))
+    return v;
+
+  v = read_wdl_table(pos, &s);
+  if (s) probe_cache_put(key, v, s);
+  if (s != 1) *success = s;
+  return v;
+}
+
+static int probe_dtm_table(Pos *pos, int won, int *success)
+{
+  Key key = probe_cache_key(pos, PC_DTM, won);
+  int v, s = 1;
+
+  if (probe_cache_get(pos, key, PC_DTM, &v, success))
+    return v;
+
+  v = read_dtm_table(pos, won, &s);
+  if (s) probe_cache_put(key, v, s);
+  if (s != 1) *success = s;
+  return v;
+}
+
+// The value of wdl MUST correspond to the WDL value of the position without
+// en passant rights.
+static int probe_dtz_table(Pos *pos, int wdl, int *success)
+{
+  Key key = probe_cache_key(pos, PC_DTZ, wdl);
+  int v, s = 1;
+
+  if (probe_cache_get(pos, key, PC_DTZ, &v, success))
+    return v;
+
+  v = read_dtz_table(pos, wdl, &s);
+  if (s) probe_cache_put(key, v, s);
+  if (s != 1) *success = s;
+  return v;
+}
+
+// TB_print_stats() is called when the engine receives the "tbstats [n]"
+// command. With SyzygyStats set, it prints how often the probe cache was
+// hit since the statistics were enabled, the n tables probed most
+// (default 20) and a histogram of the decompression times. It always
+// prints how much memory the tables use.
+
+static int cmp_probes(const void *a, const void *b)
+{
+  uint64_t pa = TB_stats[*(const int *)a].probes;
+  uint64_t pb = TB_stats[*(const int *)b].probes;
+  return pa < pb ? 1 : pa > pb ? -1 : 0;
+}
+
+static void print_table_stats(int num)
+{
+  static const char *names[] = { "WDL", "DTM", "DTZ" };
+  int n = 3 * (TBnum_piece + TBnum_pawn), cnt = 0;
+  int *list = malloc(n * sizeof(int));
+
+  for (int i = 0; i < n; i++)
+    if (TB_stats[i].probes || TB_stats[i].reads)
+      list[cnt++] = i;
+  qsort(list, cnt, sizeof(int), cmp_probes);
+
+  printf("\nMaterial  Table  Probes        Cache hits    Reads         Cold"
+         "        Avg us  Resident MB");
+  for (int k = 0; k < min(cnt, num); k++) {
+    int i = list[k], type;
+    char *str = tb_name(i, &type);
+    struct TBStats *s = &TB_stats[i];
+    struct TBEntry *e = tb_entry(i);
+    uint64_t reads = s->reads;
+    int loaded = atomic_load_explicit(&e->ready, memory_order_acquire) && e->data;
+    printf("\n%-9s %-6s %-13" PRIu64 " %-13" PRIu64 " %-13" PRIu64
+           " %-11" PRIu64 " %-7.2f %.1f", str, names[type],
+           (uint64_t)s->probes, (uint64_t)s->hits, reads, (uint64_t)s->cold,
+           reads ? s->nanos / 1000.0 / reads : 0.0,
+           loaded ? resident_bytes(e) / 1048576.0 : 0.0);
+  }
+  if (cnt > num)
+    printf("\n(%d more tables)", cnt - num);
+  free(list);
+
+  printf("\n\nDecompression  WDL           DTM           DTZ");
+  for (int b = 0; b < TB_HIST_BUCKETS; b++) {
+    uint64_t h[3];
+    for (int t = 0; t < 3; t++)
+      h[t] = atomic_load_explicit(&DecodeHist[t][b], memory_order_relaxed);
+    if (!h[0] && !h[1] && !h[2])
+      continue;
+    double ns = 128.0 * (1ULL << b);
+    if (b < TB_HIST_BUCKETS - 1)
+      printf(ns < 1000 ? "\n< %-4.0f ns     " : ns < 1e6 ? "\n< %-4.0f us     "
+             : "\n< %-4.0f ms     ", ns < 1000 ? ns : ns < 1e6 ? ns / 1e3 : ns / 1e6);
+    else
+      printf("\nlonger        ");
+    printf("%-13" PRIu64 " %-13" PRIu64 " %" PRIu64, h[0], h[1], h[2]);
+  }
+  printf("\n");
+}
+
+void TB_print_stats(char *str)
+{
+  static const char *names[] = { "WDL", "DTM", "DTZ" };
+  int num = str ? atoi(str) : 0;
+
+  if (!TB_StatsOn)
+    printf("\nSet SyzygyStats to collect probe statistics.\n");
+  else {
+    uint64_t n[3] = { 0 }, h[3] = { 0 };
+    for (int i = 0; i < 3 * (TBnum_piece + TBnum_pawn); i++) {
+      int type;
+      tb_name(i, &type);
+      n[type] += TB_stats[i].probes;
+      h[type] += TB_stats[i].hits;
+    }
+
+    printf("\nTable  Probes        Cache hits");
+    for (int i = 0; i < 3; i++)
+      printf("\n%-6s %-13" PRIu64 " %" PRIu64 " (%.1f%%)", names[i], n[i],
+             h[i], n[i] ? 100.0 * h[i] / n[i] : 0.0);
+    printf("\n");
+    print_table_stats(num > 0 ? num : 20);
+  }
+  print_memory_stats();
+  fflush(stdout);
+}
+
+// The tables to preload, smallest first, are handed out to the threads
+// one at a time.
+static int *PreloadList;
+static int PreloadNum, PreloadPieces;
+static atomic_int NextPreload, PreloadCount;
+static atomic_uint_fast64_t PreloadBytes, PreloadLocked;
+
+static void preload_job(Pos *pos)
+{
+  (void)pos;
+  uint64_t locked = 0;
+
+  while (1) {
+    int i = atomic_fetch_add(&NextPreload, 1);
+    if (i >= PreloadNum)
+      break;
+    uint64_t size = pin_table(PreloadList[i], PreloadPieces, &locked);
+    if (size) {
+      atomic_fetch_add(&PreloadCount, 1);
+      atomic_fetch_add(&PreloadBytes, size);
+    }
+  }
+  atomic_fetch_add(&PreloadLocked, locked);
+}
+
+// TB_preload() is called when SyzygyPreload or SyzygyPath is set. It
+// unpins the tables pinned before and then loads and pins the WDL and DTM
+// tables with at most the given number of pieces on all threads.
+
+void TB_preload(int pieces)
+{
+  if (!path_string)
+    return;
+
+  LOCK(TB_mutex);
+  unpin_tables();
+  UNLOCK(TB_mutex);
+
+  if (!pieces)
+    return;
+
+  int n = 3 * (TBnum_piece + TBnum_pawn);
+  PreloadList = malloc(n * sizeof(int));
+  PreloadNum = 0;
+  for (int k = 3; k <= pieces; k++)
+    for (int i = 0; i < n; i++)
+      if (tb_entry(i)->num == k)
+        PreloadList[PreloadNum++] = i;
+
+  PreloadPieces = pieces;
+  atomic_store(&NextPreload, 0);
+  atomic_store(&PreloadCount, 0);
+  atomic_store(&PreloadBytes, 0);
+  atomic_store(&PreloadLocked, 0);
+
+  TimePoint elapsed = now();
+  // Leave a running search alone and load the tables on this thread.
+  if (Signals.searching)
+    preload_job(NULL);
+  else
+    threads_run_job(preload_job);
+  elapsed = now() - elapsed;
+
+  uint64_t resident = 0;
+  for (int i = 0; i < PreloadNum; i++) {
+    struct TBEntry *e = tb_entry(PreloadList[i]);
+    if (atomic_load_explicit(&e->hot, memory_order_relaxed) == 2)
+      resident += resident_bytes(e);
+  }
+  free(PreloadList);
+
+  printf("info string Preloaded %d tablebases, %.1f MB (%.1f MB locked, "
+         "%.1f MB resident) in %d ms.\n", atomic_load(&PreloadCount),
+         atomic_load(&PreloadBytes) / 1048576.0,
+         atomic_load(&PreloadLocked) / 1048576.0, resident / 1048576.0,
+         (int)elapsed);
+  fflush(stdout);
+}
+
+// entry_pairs() stores the compressed parts of a loaded WDL (type 0) or
+// DTM (type 1) table that are not constant and returns their number.
+static int entry_pairs(struct TBEntry *entry, int type, struct PairsData **pairs)
+{
+  int split = entry->data[4] & 0x01;
+  int files = entry->has_pawns && (entry->data[4] & 0x02) ? (type ? 6 : 4) : 1;
+  int n = 0;
+
+  for (int f = 0; f < files; f++)
+    for (int i = 0; i <= split; i++) {
+      struct PairsData *d =
+              !entry->has_pawns ? ((struct TBEntry_piece *)entry)->precomp[i]
+            : !type ? ((struct TBEntry_pawn *)entry)->file[f].precomp[i]
+            : ((struct TBEntry_pawn2 *)entry)->rank[f].precomp[i];
+      if (d->idxbits && d->tb_size)
+        pairs[n++] = d;
+    }
+
+  return n;
+}
+
+#define TB_BENCH_PROBES (1 << 20)
+
+static double bench_rate(int num, TimePoint elapsed)
+{
+  return (double)num / (elapsed + 1) / 1000.0;
+}
+
+// TB_bench() is called when the engine receives the "tbbench [pieces]"
+// command. It loads the WDL and DTM tables of up to 'pieces' pieces
+// (default 5) and decodes the same random indices of them with and without
+// the lookup tables of the Huffman decoder, after a first pass to bring
+// the blocks into memory. Both decoders must return the same values.
+
+void TB_bench(char *str)
+{
+  int pieces = atoi(str);
+  if (pieces <= 0)
+    pieces = 5;
+
+  if (!path_string) {
+    printf("No tablebases found\n");
+    return;
+  }
+
+  if (Signals.searching)
+    thread_wait_for_search_finished(threads_main());
+
+  int n = 3 * (TBnum_piece + TBnum_pawn), tables = 0, num = 0, lookups = 0;
+  struct PairsData **pairs = malloc(n * 12 * sizeof(struct PairsData *));
+
+  LOCK(TB_mutex);
+  for (int i = 0; i < n; i++) {
+    int type;
+    tb_name(i, &type);
+    struct TBEntry *e = tb_entry(i);
+    if (type == 2 || e->num > pieces || !load_table(i))
+      continue;
+    tables++;
+    num += entry_pairs(e, type, pairs + num);
+  }
+  UNLOCK(TB_mutex);
+
+  if (!num) {
+    printf("No tables with up to %d pieces\n", pieces);
+    free(pairs);
+    return;
+  }
+
+  struct PairsData **d = malloc(TB_BENCH_PROBES * sizeof(struct PairsData *));
+  uint64_t *idx = malloc(TB_BENCH_PROBES * sizeof(uint64_t));
+  uint8_t **res = malloc(2 * TB_BENCH_PROBES * sizeof(uint8_t *));
+  uint16_t **saved = malloc(num * sizeof(uint16_t *));
+  PRNG rng;
+  prng_init(&rng, 1070372);
+
+  for (int k = 0; k < TB_BENCH_PROBES; k++) {
+    d[k] = pairs[prng_rand(&rng) % num];
+    idx[k] = prng_rand(&rng) % d[k]->tb_size;
+  }
+  for (int j = 0; j < num; j++)
+    lookups += pairs[j]->lookup != NULL;
+
+  TimePoint t[3];
+  for (int k = 0; k < TB_BENCH_PROBES; k++)
+    res[k] = decompress_pairs(d[k], idx[k]);
+
+  t[0] = now();
+  for (int k = 0; k < TB_BENCH_PROBES; k++)
+    res[k] = decompress_pairs(d[k], idx[k]);
+  t[1] = now();
+  for (int j = 0; j < num; j++) {
+    saved[j] = pairs[j]->lookup;
+    pairs[j]->lookup = NULL;
+  }
+  for (int k = 0; k < TB_BENCH_PROBES; k++)
+    res[TB_BENCH_PROBES + k] = decompress_pairs(d[k], idx[k]);
+  t[2] = now();
+  for (int j = 0; j < num; j++)
+    pairs[j]->lookup = saved[j];
+
+  int mismatches = 0;
+  for (int k = 0; k < TB_BENCH_PROBES; k++)
+    mismatches += res[k] != res[TB_BENCH_PROBES + k];
+
+  printf("\n===========================");
+  printf("\nTables          : %d (%d of %d parts with lookup)", tables,
+         lookups, num);
+  printf("\nProbes          : %d", TB_BENCH_PROBES);
+  printf("\nLookup decode   : %.2f Mprobes/s",
+         bench_rate(TB_BENCH_PROBES, t[1] - t[0]));
+  printf("\nLinear decode   : %.2f Mprobes/s",
+         bench_rate(TB_BENCH_PROBES, t[2] - t[1]));
+  printf("\nMismatches      : %d\n", mismatches);
+  fflush(stdout);
+
+  free(saved);
+  free(res);
+  free(idx);
+  free(d);
+  free(pairs);
+}
+
+// prefetch_wdl() asks the OS to start reading the block of the WDL table
+// holding the position, if the table has been loaded.
+static void prefetch_wdl(Pos *pos)
+{
+  Key key = pos_material_key();
+  if (key == 2ULL)
+    return;
+
+  struct TBHashEntry *ptr2 = TB_hash[key >> (64 - TBHASHBITS)];
+  int i;
+  for (i = 0; i < HSHMAX; i++)
+    if (ptr2[i].key == key) break;
+  if (i == HSHMAX)
+    return;
+
+  struct TBEntry *ptr = ptr2[i].ptr;
+  if (!atomic_load_explicit(&ptr->ready, memory_order_acquire))
+    return;
+
+  uint64_t idx;
+  struct PairsData *d = wdl_pairs(pos, ptr, key, &idx);
+  prefetch_pairs(d, idx);
+}
+
+// TB_prefetch_captures() is called with SyzygyPrefetch set at nodes that
+// are one capture away from the tablebases. For each capture it asks the
+// OS to read the WDL block that the probe after the capture will need.
+// The blocks of all captures are then read from disk in parallel instead
+// of one at a time when the search gets to them. The moves made here are
+// not searched, so they are taken back out of the node count.
+void TB_prefetch_captures(Pos *pos)
+{
+  uint64_t nodes = pos->nodes;
+  ExtMove *m = (pos->st-1)->endMoves;
+  ExtMove *end =  pos_checkers() ? generate_evasions(pos, m)
+                                 : generate_captures(pos, m);
+  pos->st->endMoves = end;
+
+  for (; m < end; m++) {
+    Move move = m->move;
+    if (!is_capture(pos, move) || !is_legal(pos, move))
+      continue;
+    do_move(pos, move, gives_check(pos, pos->st, move));
+    prefetch_wdl(pos);
+    undo_move(pos, move);
+  }
+
+  pos->nodes = nodes;
+}
+
 // Add underpromotion captures to list of captures.
 static ExtMove *add_underprom_caps(Pos *pos, ExtMove *m, ExtMove *end)
 {
@@ -903,6 +1384,8 @@ int TB_root_probe_dtz(Pos *pos, RootMoves *rm)
   // Probe, rank and score each move.
   pos->st->endMoves = (pos->st-1)->endMoves;
   for (int i = 0; i < rm->size; i++) {
+    if (atomic_load_explicit(&TB_RootProbeStop, memory_order_relaxed))
+      return 0;
     RootMove *m = &rm->move[i];
     do_move(pos, m->pv[0], gives_check(pos, pos->st, m->pv[0]));
 
@@ -968,6 +1451,8 @@ int TB_root_probe_wdl(Pos *pos, RootMoves *rm)
   // Probe, rank and score each move.
   pos->st->endMoves = (pos->st-1)->endMoves;
   for (int i = 0; i < rm->size; i++) {
+    if (atomic_load_explicit(&TB_RootProbeStop, memory_order_relaxed))
+      return 0;
     RootMove *m = &rm->move[i];
     do_move(pos, m->pv[0], gives_check(pos, pos->st, m->pv[0]));
     v = -TB_probe_wdl(pos, &success);
@@ -991,6 +1476,8 @@ int TB_root_probe_dtm(Pos *pos, RootMoves *rm)
   // Probe each move.
   pos->st->endMoves = (pos->st-1)->endMoves;
   for (int i = 0; i < rm->size; i++) {
+    if (atomic_load_explicit(&TB_RootProbeStop, memory_order_relaxed))
+      return 0;
     RootMove *m = &rm->move[i];
 
     // Use TBScore to find out if the position is won or lost.
@@ -5,9 +5,13 @@
 
 extern int TB_MaxCardinality;
 extern int TB_MaxCardinalityDTM;
+extern atomic_bool TB_RootProbeStop;
 
 void TB_init(char *path);
 void TB_free(void);
+void TB_set_memory_limit(int mb);
+void TB_preload(int pieces);
+void TB_set_stats(int on);
 int TB_probe_wdl(Pos *pos, int *success);
 int TB_probe_dtz(Pos *pos, int *success);
 Value TB_probe_dtm(Pos *pos, int wdl, int *success);
@@ -15,6 +19,9 @@ int TB_root_probe_wdl(Pos *pos, RootMoves *rm);
 int TB_root_probe_dtz(Pos *pos, RootMoves *rm);
 int TB_root_probe_dtm(Pos *pos, RootMoves *rm);
 void TB_expand_mate(Pos *pos, RootMove *move);
+void TB_prefetch_captures(Pos *pos);
+void TB_print_stats(char *str);
+void TB_bench(char *str);
 
 #endif
 
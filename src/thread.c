@@ -37,6 +37,30 @@ MainThread mainThread;
 CounterMoveHistoryStat **cmh_tables = NULL;
 int num_cmh_tables = 0;
 
+// The pawn table must start at a cache line boundary, which calloc() does
+// not guarantee. (numa_alloc() returns whole pages.)
+
+static PawnEntry *pawn_table_alloc(void)
+{
+  size_t size = PAWN_ENTRIES * sizeof(PawnEntry);
+#ifndef __WIN32__
+  PawnEntry *table = aligned_alloc(64, size);
+#else
+  PawnEntry *table = _aligned_malloc(size, 64);
+#endif
+  memset(table, 0, size);
+  return table;
+}
+
+static void pawn_table_free(PawnEntry *table)
+{
+#ifndef __WIN32__
+  free(table);
+#else
+  _aligned_free(table);
+#endif
+}
+
 // thread_init() is where a search thread starts and initialises itself.
 
 void thread_init(void *arg)
@@ -79,7 +103,7 @@ void thread_init(void *arg)
     pos->moveList = numa_alloc(10000 * sizeof(ExtMove));
   } else {
     pos = calloc(sizeof(Pos), 1);
-    pos->pawnTable = calloc(PAWN_ENTRIES * sizeof(PawnEntry), 1);
+    pos->pawnTable = pawn_table_alloc();
     pos->materialTable = calloc(8192 * sizeof(MaterialEntry), 1);
     pos->counterMoves = calloc(sizeof(CounterMoveStat), 1);
     pos->history = calloc(sizeof(ButterflyHistory), 1);
@@ -177,7 +201,7 @@ void thread_destroy(Pos *pos)
     numa_free(pos->moveList, 10000 * sizeof(ExtMove));
     numa_free(pos, sizeof(Pos));
   } else {
-    free(pos->pawnTable);
+    pawn_table_free(pos->pawnTable);
     free(pos->materialTable);
     free(pos->counterMoves);
     free(pos->history);
@@ -262,7 +286,9 @@ void thread_idle_loop(Pos *pos)
     if (pos->exit)
       break;
 
-    if (pos->thread_idx == 0)
+    if (Threads.job)
+      Threads.job(pos);
+    else if (pos->thread_idx == 0)
       mainthread_search();
     else
       thread_search(pos);
@@ -279,7 +305,9 @@ void thread_idle_loop(Pos *pos)
     if (pos->exit)
       break;
 
-    if (pos->thread_idx == 0)
+    if (Threads.job)
+      Threads.job(pos);
+    else if (pos->thread_idx == 0)
       mainthread_search();
     else
       thread_search(pos);
@@ -366,6 +394,23 @@ void threads_set_number(int num)
 }
 
 
+// threads_run_job() runs the given function on all threads in parallel
+// instead of a search and returns when every thread has finished it.
+
+void threads_run_job(void (*job)(Pos *))
+{
+  Threads.job = job;
+
+  for (int idx = 0; idx < Threads.num_threads; idx++)
+    thread_start_searching(Threads.pos[idx], 0);
+
+  for (int idx = 0; idx < Threads.num_threads; idx++)
+    thread_wait_for_search_finished(Threads.pos[idx]);
+
+  Threads.job = NULL;
+}
+
+
 // threads_nodes_searched() returns the number of nodes searched.
 
 uint64_t threads_nodes_searched(void)
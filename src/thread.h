@@ -77,6 +77,7 @@ void mainthread_search();
 struct ThreadPool {
   Pos *pos[MAX_THREADS];
   int num_threads;
+  void (*job)(Pos *);
 #ifndef __WIN32__
   pthread_mutex_t mutex;
   pthread_cond_t sleepCondition;
@@ -92,6 +93,7 @@ void threads_init(void);
 void threads_exit(void);
 void threads_start_thinking(Pos *pos, LimitsType *);
 void threads_set_number(int num);
+void threads_run_job(void (*job)(Pos *));
 uint64_t threads_nodes_searched(void);
 uint64_t threads_tb_hits(void);
 
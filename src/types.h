@@ -100,6 +100,24 @@
 #define HasPext 0
 #endif
 
+#ifdef USE_AVX2
+#define HasAvx2 1
+#else
+#define HasAvx2 0
+#endif
+
+#ifdef USE_AVX512
+#define HasAvx512 1
+#else
+#define HasAvx512 0
+#endif
+
+#ifdef PREGEN
+#define HasPregen 1
+#else
+#define HasPregen 0
+#endif
+
 #ifdef IS_64BIT
 #define Is64Bit 1
 #else
@@ -29,11 +29,15 @@
 #include "position.h"
 #include "search.h"
 #include "settings.h"
+#include "tbprobe.h"
 #include "thread.h"
 #include "timeman.h"
 #include "uci.h"
 
 extern void benchmark(Pos *pos, char *str);
+extern void batch(char *str);
+extern void gentables(char *str);
+extern void microbench(char *str);
 
 // FEN string of the initial position, normal chess
 const char* StartFEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
@@ -198,8 +202,13 @@ void go(Pos *pos, char *str)
       Limits.ponder = 1;
     else if (strcmp(token, "perft") == 0) {
       char str_buf[64];
-      sprintf(str_buf, "%d %d %d current perft", option_value(OPT_HASH),
-                    option_value(OPT_THREADS), atoi(strtok(NULL, " \t")));
+      char *arg = strtok(NULL, " \t");
+      int divide = arg && strcmp(arg, "divide") == 0;
+      if (divide)
+        arg = strtok(NULL, " \t");
+      sprintf(str_buf, "%d %d %d current %s", option_value(OPT_HASH),
+                    option_value(OPT_THREADS), arg ? atoi(arg) : 1,
+                    divide ? "divide" : "perft");
       benchmark(pos, str_buf);
       return;
     }
@@ -294,7 +303,7 @@ void uci_loop(int argc, char **argv)
     if (   strcmp(token, "quit") == 0
         || strcmp(token, "stop") == 0) {
       if (Signals.searching) {
-        Signals.stop = 1;
+        Signals.stopCommand = Signals.stop = 1;
         LOCK(Signals.lock);
         if (Signals.sleeping)
           thread_start_searching(threads_main(), 1); // Wake up main thread.
@@ -337,10 +346,23 @@ void uci_loop(int argc, char **argv)
 
     // Additional custom non-UCI commands, useful for debugging
     else if (strcmp(token, "bench") == 0)     benchmark(&pos, str);
+    else if (strcmp(token, "batch") == 0)     batch(str);
+    else if (strcmp(token, "gentables") == 0) gentables(str);
+    else if (strcmp(token, "attackbench") == 0) attacks_bench();
+    else if (strcmp(token, "microbench") == 0) microbench(str);
+    else if (strcmp(token, "tbstats") == 0)   TB_print_stats(str);
+    else if (strcmp(token, "tbbench") == 0)   TB_bench(str);
     else if (strcmp(token, "d") == 0)         print_pos(&pos);
+    else if (strcmp(token, "eval") == 0) {
+      pos.pawnTable = threads_main()->pawnTable;
+      pos.materialTable = threads_main()->materialTable;
+      eval_trace(&pos);
+    }
     else if (strcmp(token, "perft") == 0) {
-      sprintf(str_buf, "%d %d %d current perft", option_value(OPT_HASH),
-                    option_value(OPT_THREADS), atoi(str));
+      int divide = strncmp(str, "divide", 6) == 0;
+      sprintf(str_buf, "%d %d %d current %s", option_value(OPT_HASH),
+                    option_value(OPT_THREADS), atoi(divide ? str + 6 : str),
+                    divide ? "divide" : "perft");
       benchmark(&pos, str_buf);
     }
     else {
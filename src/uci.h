@@ -54,8 +54,12 @@ typedef void (*OnChange)(Option *);
 #define OPT_SYZ_50_MOVE     14
 #define OPT_SYZ_PROBE_LIMIT 15
 #define OPT_SYZ_USE_DTM     16
-#define OPT_LARGE_PAGES     17
-#define OPT_NUMA            18
+#define OPT_SYZ_MEM_LIMIT   17
+#define OPT_SYZ_PREFETCH    18
+#define OPT_SYZ_PRELOAD     19
+#define OPT_SYZ_STATS       20
+#define OPT_LARGE_PAGES     21
+#define OPT_NUMA            22
 
 struct Option {
   char *name;
@@ -72,7 +72,24 @@ static void on_threads(Option *opt)
 
 static void on_tb_path(Option *opt)
 {
+  tb_cancel_ranking();
   TB_init(opt->val_string);
+  TB_preload(option_value(OPT_SYZ_PRELOAD));
+}
+
+static void on_tb_memory_limit(Option *opt)
+{
+  TB_set_memory_limit(opt->value);
+}
+
+static void on_tb_preload(Option *opt)
+{
+  TB_preload(opt->value);
+}
+
+static void on_tb_stats(Option *opt)
+{
+  TB_set_stats(opt->value);
 }
 
 static void on_largepages(Option *opt)
@@ -102,8 +119,12 @@ static Option options_map[] = {
   { "SyzygyPath", OPT_TYPE_STRING, 0, 0, 0, "<empty>", on_tb_path, 0, NULL },
   { "SyzygyProbeDepth", OPT_TYPE_SPIN, 1, 1, 100, NULL, NULL, 0, NULL },
   { "Syzygy50MoveRule", OPT_TYPE_CHECK, 1, 0, 0, NULL, NULL, 0, NULL },
-  { "SyzygyProbeLimit", OPT_TYPE_SPIN, 6, 0, 6, NULL, NULL, 0, NULL },
+  { "SyzygyProbeLimit", OPT_TYPE_SPIN, 7, 0, 7, NULL, NULL, 0, NULL },
   { "SyzygyUseDTM", OPT_TYPE_CHECK, 1, 0, 0, NULL, NULL, 0, NULL },
+  { "SyzygyMemoryLimit", OPT_TYPE_SPIN, 0, 0, MAXHASHMB, NULL, on_tb_memory_limit, 0, NULL },
+  { "SyzygyPrefetch", OPT_TYPE_CHECK, 0, 0, 0, NULL, NULL, 0, NULL },
+  { "SyzygyPreload", OPT_TYPE_SPIN, 0, 0, 7, NULL, on_tb_preload, 0, NULL },
+  { "SyzygyStats", OPT_TYPE_CHECK, 0, 0, 0, NULL, on_tb_stats, 0, NULL },
   { "LargePages", OPT_TYPE_CHECK, 1, 0, 0, NULL, on_largepages, 0, NULL },
   { "NUMA", OPT_TYPE_STRING, 0, 0, 0, "all", on_numa, 0, NULL },
   { NULL }